@@ -100,6 +100,11 @@
 
 #define NEXT_MAX_MATCH_VALUES                                    64
 
+#define NEXT_QUEUE_OVERFLOW_DROP                                  0
+#define NEXT_QUEUE_OVERFLOW_GROW                                  1
+
+#define NEXT_SLAB_NUM_SIZE_CLASSES                                8
+
 #if defined(_WIN32)
 #define NOMINMAX
 #endif
@@ -180,10 +185,44 @@ struct next_config_t
     int socket_receive_buffer_size;
     NEXT_BOOL disable_network_next;
     NEXT_BOOL disable_autodetect;
+    NEXT_BOOL enable_udp_offload;
+    int server_worker_threads;
+    NEXT_BOOL enable_io_uring;
+    char server_xdp_interface[64];
+    int server_xdp_queue;
+    int busy_poll_microseconds;
+    NEXT_BOOL server_inline_packet_dispatch;        // server packet received callback runs on the internal thread. only next_server_packet_session may be called from it
+    int client_queue_length;                        // 0 for default. rounded up to a power of two
+    int server_queue_length;                        // 0 for default. rounded up to a power of two
+    int queue_overflow_policy;                      // NEXT_QUEUE_OVERFLOW_DROP or NEXT_QUEUE_OVERFLOW_GROW
+    int server_preallocated_sessions;               // 0 for default. session slots allocated up front at next_server_create
+    int server_max_sessions;                        // 0 for unlimited. upgrades past this many sessions are refused
+    uint64_t server_session_memory_budget;          // 0 for unlimited. bytes of session storage allocated up front at next_server_create
+    int server_crypto_threads;                      // 0 signs packets on the server thread. otherwise signing runs on this many worker threads (linux only, not with busy poll)
 };
 
 NEXT_EXPORT_FUNC void next_default_config( struct next_config_t * config );
 
+struct next_queue_stats_t
+{
+    int capacity;
+    int peak_depth;
+    uint64_t pushes;
+    uint64_t drops;
+    uint64_t grows;
+};
+
+struct next_slab_stats_t
+{
+    int block_bytes[NEXT_SLAB_NUM_SIZE_CLASSES];
+    int num_blocks[NEXT_SLAB_NUM_SIZE_CLASSES];
+    int num_allocated[NEXT_SLAB_NUM_SIZE_CLASSES];
+    int high_water[NEXT_SLAB_NUM_SIZE_CLASSES];
+    int num_large_allocated;
+    int large_high_water;
+    uint64_t chunk_bytes;
+};
+
 NEXT_EXPORT_FUNC int next_init( void * context, struct next_config_t * config );
 
 NEXT_EXPORT_FUNC void next_term();
@@ -321,6 +360,10 @@ NEXT_EXPORT_FUNC const struct next_address_t * next_client_server_address( struc
 
 NEXT_EXPORT_FUNC NEXT_BOOL next_client_ready( struct next_client_t * client );
 
+NEXT_EXPORT_FUNC void next_client_queue_stats( struct next_client_t * client, struct next_queue_stats_t * command_stats, struct next_queue_stats_t * notify_stats );
+
+NEXT_EXPORT_FUNC void next_client_slab_stats( struct next_client_t * client, struct next_slab_stats_t * command_stats, struct next_slab_stats_t * notify_stats );
+
 // -----------------------------------------
 
 struct next_server_stats_t
@@ -357,12 +400,23 @@ struct next_server_stats_t
     uint64_t tags[NEXT_MAX_TAGS];
 };
 
+struct next_server_packet_t
+{
+    struct next_address_t to_address;
+    const uint8_t * packet_data;
+    int packet_bytes;
+};
+
 #define NEXT_SERVER_STATE_DIRECT_ONLY               0
 #define NEXT_SERVER_STATE_INITIALIZING              1
 #define NEXT_SERVER_STATE_INITIALIZED               2
 
 struct next_server_t;
 
+typedef uint64_t next_session_handle_t;
+
+#define NEXT_INVALID_SESSION_HANDLE                 0
+
 NEXT_EXPORT_FUNC struct next_server_t * next_server_create( void * context, const char * server_address, const char * bind_address, const char * datacenter, void (*packet_received_callback)( struct next_server_t * server, void * context, const struct next_address_t * from, const uint8_t * packet_data, int packet_bytes ), void (*wake_up_callback)( void * context ) );
 
 NEXT_EXPORT_FUNC void next_server_destroy( struct next_server_t * server );
@@ -373,7 +427,7 @@ NEXT_EXPORT_FUNC struct next_address_t next_server_address( struct next_server_t
 
 NEXT_EXPORT_FUNC void next_server_update( struct next_server_t * server );
 
-NEXT_EXPORT_FUNC uint64_t next_server_upgrade_session( struct next_server_t * server, const struct next_address_t * address, const char * user_id );
+NEXT_EXPORT_FUNC next_session_handle_t next_server_upgrade_session( struct next_server_t * server, const struct next_address_t * address, const char * user_id );
 
 NEXT_EXPORT_FUNC void next_server_tag_session( struct next_server_t * server, const struct next_address_t * address, const char * tag );
 
@@ -383,12 +437,16 @@ NEXT_EXPORT_FUNC NEXT_BOOL next_server_session_upgraded( struct next_server_t *
 
 NEXT_EXPORT_FUNC void next_server_send_packet( struct next_server_t * server, const struct next_address_t * to_address, const uint8_t * packet_data, int packet_bytes );
 
+NEXT_EXPORT_FUNC void next_server_send_packets( struct next_server_t * server, const struct next_server_packet_t * packets, int num_packets );
+
 NEXT_EXPORT_FUNC void next_server_send_packet_direct( struct next_server_t * server, const struct next_address_t * to_address, const uint8_t * packet_data, int packet_bytes );
 
 NEXT_EXPORT_FUNC void next_server_send_packet_raw( struct next_server_t * server, const struct next_address_t * to_address, const uint8_t * packet_data, int packet_bytes );
 
 NEXT_EXPORT_FUNC NEXT_BOOL next_server_stats( struct next_server_t * server, const struct next_address_t * address, struct next_server_stats_t * stats );
 
+NEXT_EXPORT_FUNC int next_server_stats_all( struct next_server_t * server, struct next_server_stats_t * stats, int max_stats );
+
 NEXT_EXPORT_FUNC NEXT_BOOL next_server_ready( struct next_server_t * server );
 
 NEXT_EXPORT_FUNC const char * next_server_datacenter( struct next_server_t * server );
@@ -399,6 +457,24 @@ NEXT_EXPORT_FUNC void next_server_match( struct next_server_t * server, const st
 
 NEXT_EXPORT_FUNC void next_server_flush( struct next_server_t * server );
 
+NEXT_EXPORT_FUNC void next_server_queue_stats( struct next_server_t * server, struct next_queue_stats_t * command_stats, struct next_queue_stats_t * notify_stats );
+
+NEXT_EXPORT_FUNC void next_server_slab_stats( struct next_server_t * server, struct next_slab_stats_t * command_stats, struct next_slab_stats_t * notify_stats );
+
+NEXT_EXPORT_FUNC next_session_handle_t next_server_packet_session( struct next_server_t * server );
+
+NEXT_EXPORT_FUNC void next_server_session_send_packet( struct next_server_t * server, next_session_handle_t session, const uint8_t * packet_data, int packet_bytes );
+
+NEXT_EXPORT_FUNC NEXT_BOOL next_server_session_stats( struct next_server_t * server, next_session_handle_t session, struct next_server_stats_t * stats );
+
+NEXT_EXPORT_FUNC void next_server_session_tag( struct next_server_t * server, next_session_handle_t session, const char * tag );
+
+NEXT_EXPORT_FUNC void next_server_session_tag_multiple( struct next_server_t * server, next_session_handle_t session, const char ** tags, int num_tags );
+
+NEXT_EXPORT_FUNC void next_server_session_event( struct next_server_t * server, next_session_handle_t session, uint64_t server_events );
+
+NEXT_EXPORT_FUNC void next_server_session_match( struct next_server_t * server, next_session_handle_t session, const char * match_id, const double * match_values, int num_match_values );
+
 // -----------------------------------------
 
 #define NEXT_MUTEX_BYTES 256
@@ -430,6 +506,8 @@ struct next_mutex_helper_t
 
 NEXT_EXPORT_FUNC void next_test();
 
+NEXT_EXPORT_FUNC void next_bench();
+
 // -----------------------------------------
 
 #endif // #ifndef NEXT_H
@@ -31,6 +31,10 @@ project "next"
 		"source/next_*.cpp",
 	}
 	includedirs { "include", "sodium" }
+	filter "platforms:*avx"
+		vectorextensions "AVX"
+	filter "platforms:*avx2"
+		vectorextensions "AVX2"
 	filter "system:windows"
 		linkoptions { "/ignore:4221" }
 		disablewarnings { "4324" }
@@ -92,6 +96,18 @@ project "soak"
 	filter "system:macosx"
 		linkoptions { "-framework SystemConfiguration -framework CoreFoundation" }
 
+project "bench"
+	kind "ConsoleApp"
+	links { "next", "sodium" }
+	files { "bench.cpp" }
+	includedirs { "include" }
+	filter "system:windows"
+		disablewarnings { "4324" }
+	filter "system:not windows"
+		links { "pthread" }
+	filter "system:macosx"
+		linkoptions { "-framework SystemConfiguration -framework CoreFoundation" }
+
 project "simple_client"
 	kind "ConsoleApp"
 	links { "next", "sodium" }
@@ -38,6 +38,18 @@
 #pragma warning(pop)
 #endif
 
+#include <string.h>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define NEXT_CRYPTO_VERIFY_LANES 8
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define NEXT_CRYPTO_VERIFY_LANES 4
+#else
+#define NEXT_CRYPTO_VERIFY_LANES 1
+#endif
+
 int next_crypto_init()
 {
     return sodium_init();
@@ -152,3 +164,269 @@ int next_crypto_box_open_easy( unsigned char * m, const unsigned char * c, unsig
 {
     return crypto_box_open_easy( m, c, clen, n, pk, sk );
 }
+
+int next_crypto_box_beforenm( unsigned char * k, const unsigned char * pk, const unsigned char * sk )
+{
+    return crypto_box_beforenm( k, pk, sk );
+}
+
+int next_crypto_box_open_easy_afternm( unsigned char * m, const unsigned char * c, unsigned long long clen, const unsigned char * n, const unsigned char * k )
+{
+    return crypto_box_open_easy_afternm( m, c, clen, n, k );
+}
+
+// ---------------------------------------------------------------
+
+/*
+    Multi-buffer verification of ChaCha20-Poly1305 IETF tags over additional data with an empty message.
+
+    This is what authenticating a packet header costs, and nearly all of it is the ChaCha20 block that derives the
+    one-time Poly1305 key. Each SIMD lane runs that block for a different packet, with its own key and nonce, so
+    a receive batch derives 4 (SSE2) or 8 (AVX2) Poly1305 keys for the price of one. The Poly1305 pass over a
+    header is only two blocks, so it stays scalar per lane. Without SIMD there is a single lane and this is a
+    plain scalar implementation. The result for each item is exactly what libsodium would return for it.
+*/
+
+#if NEXT_CRYPTO_VERIFY_LANES == 8
+
+typedef __m256i next_crypto_vec_t;
+
+#define NEXT_CRYPTO_VEC_LOAD( p ) _mm256_loadu_si256( (const __m256i*) ( p ) )
+#define NEXT_CRYPTO_VEC_STORE( p, v ) _mm256_storeu_si256( (__m256i*) ( p ), v )
+#define NEXT_CRYPTO_VEC_ADD( a, b ) _mm256_add_epi32( a, b )
+#define NEXT_CRYPTO_VEC_XOR( a, b ) _mm256_xor_si256( a, b )
+#define NEXT_CRYPTO_VEC_ROTL( v, n ) _mm256_or_si256( _mm256_slli_epi32( v, n ), _mm256_srli_epi32( v, 32 - (n) ) )
+
+#elif NEXT_CRYPTO_VERIFY_LANES == 4
+
+typedef __m128i next_crypto_vec_t;
+
+#define NEXT_CRYPTO_VEC_LOAD( p ) _mm_loadu_si128( (const __m128i*) ( p ) )
+#define NEXT_CRYPTO_VEC_STORE( p, v ) _mm_storeu_si128( (__m128i*) ( p ), v )
+#define NEXT_CRYPTO_VEC_ADD( a, b ) _mm_add_epi32( a, b )
+#define NEXT_CRYPTO_VEC_XOR( a, b ) _mm_xor_si128( a, b )
+#define NEXT_CRYPTO_VEC_ROTL( v, n ) _mm_or_si128( _mm_slli_epi32( v, n ), _mm_srli_epi32( v, 32 - (n) ) )
+
+#else
+
+typedef uint32_t next_crypto_vec_t;
+
+#define NEXT_CRYPTO_VEC_LOAD( p ) ( *(p) )
+#define NEXT_CRYPTO_VEC_STORE( p, v ) ( *(p) = (v) )
+#define NEXT_CRYPTO_VEC_ADD( a, b ) ( (a) + (b) )
+#define NEXT_CRYPTO_VEC_XOR( a, b ) ( (a) ^ (b) )
+#define NEXT_CRYPTO_VEC_ROTL( v, n ) ( ( (v) << (n) ) | ( (v) >> ( 32 - (n) ) ) )
+
+#endif
+
+#define NEXT_CRYPTO_CHACHA20_QUARTERROUND( a, b, c, d )                                                     \
+    a = NEXT_CRYPTO_VEC_ADD( a, b ); d = NEXT_CRYPTO_VEC_XOR( d, a ); d = NEXT_CRYPTO_VEC_ROTL( d, 16 );    \
+    c = NEXT_CRYPTO_VEC_ADD( c, d ); b = NEXT_CRYPTO_VEC_XOR( b, c ); b = NEXT_CRYPTO_VEC_ROTL( b, 12 );    \
+    a = NEXT_CRYPTO_VEC_ADD( a, b ); d = NEXT_CRYPTO_VEC_XOR( d, a ); d = NEXT_CRYPTO_VEC_ROTL( d, 8 );     \
+    c = NEXT_CRYPTO_VEC_ADD( c, d ); b = NEXT_CRYPTO_VEC_XOR( b, c ); b = NEXT_CRYPTO_VEC_ROTL( b, 7 );
+
+static inline uint32_t next_crypto_load32_le( const uint8_t * p )
+{
+    return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ) | ( uint32_t( p[2] ) << 16 ) | ( uint32_t( p[3] ) << 24 );
+}
+
+static inline void next_crypto_store32_le( uint8_t * p, uint32_t value )
+{
+    p[0] = uint8_t( value );
+    p[1] = uint8_t( value >> 8 );
+    p[2] = uint8_t( value >> 16 );
+    p[3] = uint8_t( value >> 24 );
+}
+
+static void next_crypto_chacha20_ietf_poly1305_keys( const next_crypto_aead_verify_t * items, int num_items, uint8_t poly1305_key[NEXT_CRYPTO_VERIFY_LANES][32] )
+{
+    // IMPORTANT: State is stored transposed, one row per state word and one column per lane. Unused lanes repeat
+    // the first item so every lane does the same work, and their output is ignored.
+
+    uint32_t state[16][NEXT_CRYPTO_VERIFY_LANES];
+
+    for ( int lane = 0; lane < NEXT_CRYPTO_VERIFY_LANES; ++lane )
+    {
+        const next_crypto_aead_verify_t * item = &items[ lane < num_items ? lane : 0 ];
+        state[0][lane] = 0x61707865;
+        state[1][lane] = 0x3320646e;
+        state[2][lane] = 0x79622d32;
+        state[3][lane] = 0x6b206574;
+        for ( int i = 0; i < 8; ++i )
+        {
+            state[4+i][lane] = next_crypto_load32_le( item->k + i * 4 );
+        }
+        state[12][lane] = 0;
+        state[13][lane] = next_crypto_load32_le( item->npub );
+        state[14][lane] = next_crypto_load32_le( item->npub + 4 );
+        state[15][lane] = next_crypto_load32_le( item->npub + 8 );
+    }
+
+    next_crypto_vec_t x[16];
+    for ( int i = 0; i < 16; ++i )
+    {
+        x[i] = NEXT_CRYPTO_VEC_LOAD( state[i] );
+    }
+
+    for ( int i = 0; i < 10; ++i )
+    {
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[0], x[4], x[8], x[12] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[1], x[5], x[9], x[13] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[2], x[6], x[10], x[14] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[3], x[7], x[11], x[15] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[0], x[5], x[10], x[15] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[1], x[6], x[11], x[12] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[2], x[7], x[8], x[13] );
+        NEXT_CRYPTO_CHACHA20_QUARTERROUND( x[3], x[4], x[9], x[14] );
+    }
+
+    // only the first 32 bytes of the block are needed. they are the poly1305 key
+
+    for ( int i = 0; i < 8; ++i )
+    {
+        NEXT_CRYPTO_VEC_STORE( state[i], NEXT_CRYPTO_VEC_ADD( x[i], NEXT_CRYPTO_VEC_LOAD( state[i] ) ) );
+    }
+
+    for ( int lane = 0; lane < num_items; ++lane )
+    {
+        for ( int i = 0; i < 8; ++i )
+        {
+            next_crypto_store32_le( poly1305_key[lane] + i * 4, state[i][lane] );
+        }
+    }
+
+    sodium_memzero( state, sizeof(state) );
+    sodium_memzero( x, sizeof(x) );
+}
+
+static void next_crypto_poly1305_blocks( uint32_t h[5], const uint32_t r[5], const uint8_t * m, int num_blocks )
+{
+    const uint32_t s1 = r[1] * 5;
+    const uint32_t s2 = r[2] * 5;
+    const uint32_t s3 = r[3] * 5;
+    const uint32_t s4 = r[4] * 5;
+
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+    for ( int i = 0; i < num_blocks; ++i, m += 16 )
+    {
+        h0 += ( next_crypto_load32_le( m + 0 ) ) & 0x3ffffff;
+        h1 += ( next_crypto_load32_le( m + 3 ) >> 2 ) & 0x3ffffff;
+        h2 += ( next_crypto_load32_le( m + 6 ) >> 4 ) & 0x3ffffff;
+        h3 += ( next_crypto_load32_le( m + 9 ) >> 6 ) & 0x3ffffff;
+        h4 += ( next_crypto_load32_le( m + 12 ) >> 8 ) | ( 1 << 24 );
+
+        const uint64_t d0 = uint64_t( h0 ) * r[0] + uint64_t( h1 ) * s4 + uint64_t( h2 ) * s3 + uint64_t( h3 ) * s2 + uint64_t( h4 ) * s1;
+        uint64_t d1 = uint64_t( h0 ) * r[1] + uint64_t( h1 ) * r[0] + uint64_t( h2 ) * s4 + uint64_t( h3 ) * s3 + uint64_t( h4 ) * s2;
+        uint64_t d2 = uint64_t( h0 ) * r[2] + uint64_t( h1 ) * r[1] + uint64_t( h2 ) * r[0] + uint64_t( h3 ) * s4 + uint64_t( h4 ) * s3;
+        uint64_t d3 = uint64_t( h0 ) * r[3] + uint64_t( h1 ) * r[2] + uint64_t( h2 ) * r[1] + uint64_t( h3 ) * r[0] + uint64_t( h4 ) * s4;
+        uint64_t d4 = uint64_t( h0 ) * r[4] + uint64_t( h1 ) * r[3] + uint64_t( h2 ) * r[2] + uint64_t( h3 ) * r[1] + uint64_t( h4 ) * r[0];
+
+        uint32_t c = uint32_t( d0 >> 26 ); h0 = uint32_t( d0 ) & 0x3ffffff;
+        d1 += c; c = uint32_t( d1 >> 26 ); h1 = uint32_t( d1 ) & 0x3ffffff;
+        d2 += c; c = uint32_t( d2 >> 26 ); h2 = uint32_t( d2 ) & 0x3ffffff;
+        d3 += c; c = uint32_t( d3 >> 26 ); h3 = uint32_t( d3 ) & 0x3ffffff;
+        d4 += c; c = uint32_t( d4 >> 26 ); h4 = uint32_t( d4 ) & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+    }
+
+    h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+}
+
+static void next_crypto_poly1305_aead_tag( uint8_t * tag, const uint8_t * ad, unsigned long long adlen, const uint8_t * key )
+{
+    uint32_t r[5];
+    r[0] = ( next_crypto_load32_le( key + 0 ) ) & 0x3ffffff;
+    r[1] = ( next_crypto_load32_le( key + 3 ) >> 2 ) & 0x3ffff03;
+    r[2] = ( next_crypto_load32_le( key + 6 ) >> 4 ) & 0x3ffc0ff;
+    r[3] = ( next_crypto_load32_le( key + 9 ) >> 6 ) & 0x3f03fff;
+    r[4] = ( next_crypto_load32_le( key + 12 ) >> 8 ) & 0x00fffff;
+
+    uint32_t h[5] = { 0, 0, 0, 0, 0 };
+
+    // the message is the additional data padded to 16 bytes, an empty ciphertext, then both lengths
+
+    const int full_blocks = int( adlen / 16 );
+    next_crypto_poly1305_blocks( h, r, ad, full_blocks );
+
+    uint8_t block[16];
+
+    const int remainder = int( adlen % 16 );
+    if ( remainder )
+    {
+        memset( block, 0, sizeof(block) );
+        memcpy( block, ad + full_blocks * 16, remainder );
+        next_crypto_poly1305_blocks( h, r, block, 1 );
+    }
+
+    next_crypto_store32_le( block + 0, uint32_t( adlen ) );
+    next_crypto_store32_le( block + 4, uint32_t( adlen >> 32 ) );
+    memset( block + 8, 0, 8 );
+    next_crypto_poly1305_blocks( h, r, block, 1 );
+
+    // fully carry h, then compute h + -p and select h or h - p in constant time
+
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+    uint32_t c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - ( 1 << 26 );
+
+    uint32_t mask = ( g4 >> 31 ) - 1;
+    g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+    mask = ~mask;
+    h0 = ( h0 & mask ) | g0;
+    h1 = ( h1 & mask ) | g1;
+    h2 = ( h2 & mask ) | g2;
+    h3 = ( h3 & mask ) | g3;
+    h4 = ( h4 & mask ) | g4;
+
+    // h = ( h + s ) % 2^128
+
+    h0 = ( h0 ) | ( h1 << 26 );
+    h1 = ( h1 >> 6 ) | ( h2 << 20 );
+    h2 = ( h2 >> 12 ) | ( h3 << 14 );
+    h3 = ( h3 >> 18 ) | ( h4 << 8 );
+
+    uint64_t f = uint64_t( h0 ) + next_crypto_load32_le( key + 16 ); next_crypto_store32_le( tag + 0, uint32_t( f ) );
+    f = uint64_t( h1 ) + next_crypto_load32_le( key + 20 ) + ( f >> 32 ); next_crypto_store32_le( tag + 4, uint32_t( f ) );
+    f = uint64_t( h2 ) + next_crypto_load32_le( key + 24 ) + ( f >> 32 ); next_crypto_store32_le( tag + 8, uint32_t( f ) );
+    f = uint64_t( h3 ) + next_crypto_load32_le( key + 28 ) + ( f >> 32 ); next_crypto_store32_le( tag + 12, uint32_t( f ) );
+}
+
+int next_crypto_aead_chacha20poly1305_ietf_verify_lanes()
+{
+    return NEXT_CRYPTO_VERIFY_LANES;
+}
+
+void next_crypto_aead_chacha20poly1305_ietf_verify_batch( next_crypto_aead_verify_t * items, int num_items )
+{
+    uint8_t poly1305_key[NEXT_CRYPTO_VERIFY_LANES][32];
+
+    for ( int i = 0; i < num_items; i += NEXT_CRYPTO_VERIFY_LANES )
+    {
+        const int num_lanes = ( num_items - i < NEXT_CRYPTO_VERIFY_LANES ) ? ( num_items - i ) : NEXT_CRYPTO_VERIFY_LANES;
+
+        next_crypto_chacha20_ietf_poly1305_keys( items + i, num_lanes, poly1305_key );
+
+        for ( int lane = 0; lane < num_lanes; ++lane )
+        {
+            next_crypto_aead_verify_t * item = &items[i+lane];
+            uint8_t tag[NEXT_CRYPTO_AEAD_CHACHA20POLY1305_IETF_ABYTES];
+            next_crypto_poly1305_aead_tag( tag, item->ad, item->adlen, poly1305_key[lane] );
+            item->result = crypto_verify_16( tag, item->tag );
+        }
+    }
+
+    sodium_memzero( poly1305_key, sizeof(poly1305_key) );
+}
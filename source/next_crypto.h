@@ -39,6 +39,7 @@
 #define NEXT_CRYPTO_BOX_NONCEBYTES                          24
 #define NEXT_CRYPTO_BOX_PUBLICKEYBYTES                      32
 #define NEXT_CRYPTO_BOX_SECRETKEYBYTES                      32
+#define NEXT_CRYPTO_BOX_BEFORENMBYTES                       32
 
 #define NEXT_CRYPTO_SIGN_BYTES                              64
 #define NEXT_CRYPTO_SIGN_PUBLICKEYBYTES                     32
@@ -103,4 +104,22 @@ int next_crypto_box_easy( unsigned char * c, const unsigned char * m, unsigned l
 
 int next_crypto_box_open_easy( unsigned char * m, const unsigned char * c, unsigned long long clen, const unsigned char * n, const unsigned char * pk, const unsigned char * sk );
 
+int next_crypto_box_beforenm( unsigned char * k, const unsigned char * pk, const unsigned char * sk );
+
+int next_crypto_box_open_easy_afternm( unsigned char * m, const unsigned char * c, unsigned long long clen, const unsigned char * n, const unsigned char * k );
+
+struct next_crypto_aead_verify_t
+{
+    const unsigned char * ad;
+    unsigned long long adlen;
+    const unsigned char * tag;
+    unsigned char npub[NEXT_CRYPTO_AEAD_CHACHA20POLY1305_IETF_NPUBBYTES];
+    const unsigned char * k;
+    int result;
+};
+
+int next_crypto_aead_chacha20poly1305_ietf_verify_lanes();
+
+void next_crypto_aead_chacha20poly1305_ietf_verify_batch( struct next_crypto_aead_verify_t * items, int num_items );
+
 #endif // #ifndef NEXT_CRYPTO_H
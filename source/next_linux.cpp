@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <ifaddrs.h>
 #include <fcntl.h>
 #include <netdb.h>
@@ -43,6 +44,17 @@
 #include <stdlib.h>
 #include <math.h>
 #include <alloca.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/bpf.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <stddef.h>
 
 extern void * next_global_context;
 
@@ -50,6 +62,71 @@ extern void * next_malloc( void * context, size_t bytes );
 
 extern void next_free( void * context, void * p );
 
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT                                                   103
+#endif // #ifndef UDP_SEGMENT
+
+#ifndef UDP_GRO
+#define UDP_GRO                                                       104
+#endif // #ifndef UDP_GRO
+
+#define NEXT_PLATFORM_GSO_MAX_SEGMENTS                                 64
+#define NEXT_PLATFORM_GSO_MAX_SEGMENT_BYTES                          1472
+#define NEXT_PLATFORM_GSO_MAX_BYTES                                 65000
+#define NEXT_PLATFORM_GRO_BATCH_SIZE                                    8
+#define NEXT_PLATFORM_GRO_BUFFER_BYTES                              65536
+#define NEXT_PLATFORM_GRO_CONTROL_BYTES                                64
+
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define NEXT_PLATFORM_HAS_IO_URING                                      1
+#else // #if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define NEXT_PLATFORM_HAS_IO_URING                                      0
+#endif // #if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+
+#define NEXT_PLATFORM_IO_URING_QUEUE_DEPTH                              8
+#define NEXT_PLATFORM_IO_URING_NUM_BUFFERS                            256
+#define NEXT_PLATFORM_IO_URING_BUFFER_BYTES                          4352
+#define NEXT_PLATFORM_IO_URING_BUFFER_GROUP                             0
+#define NEXT_PLATFORM_IO_URING_RECEIVE_USER_DATA                        1
+#define NEXT_PLATFORM_IO_URING_CANCEL_USER_DATA                         2
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL                                                   46
+#endif // #ifndef SO_BUSY_POLL
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL                                            69
+#endif // #ifndef SO_PREFER_BUSY_POLL
+
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET                                            70
+#endif // #ifndef SO_BUSY_POLL_BUDGET
+
+#define NEXT_PLATFORM_BUSY_POLL_BUDGET                                 64
+#define NEXT_PLATFORM_BUSY_POLL_SPIN_SAMPLE_RATE                       16
+
+#define NEXT_PLATFORM_WAITER_MAX_EVENTS                                 8
+
+#define NEXT_PLATFORM_TIMESTAMP_CONTROL_BYTES                          32
+#define NEXT_PLATFORM_MAX_TIMESTAMP_AGE                               1.0
+
+#ifndef AF_XDP
+#define AF_XDP                                                         44
+#endif // #ifndef AF_XDP
+
+#ifndef SOL_XDP
+#define SOL_XDP                                                       283
+#endif // #ifndef SOL_XDP
+
+#define NEXT_PLATFORM_XDP_NUM_FRAMES                                 2048
+#define NEXT_PLATFORM_XDP_FRAME_BYTES                                4096
+#define NEXT_PLATFORM_XDP_RING_SIZE                                  1024
+#define NEXT_PLATFORM_XDP_MAX_QUEUES                                   64
+#define NEXT_PLATFORM_XDP_HEADER_BYTES                                 42
+#define NEXT_PLATFORM_XDP_MAX_PAYLOAD_BYTES                          1472
+#define NEXT_PLATFORM_XDP_PEER_TABLE_BITS                              12
+#define NEXT_PLATFORM_XDP_PEER_TABLE_SIZE ( 1 << NEXT_PLATFORM_XDP_PEER_TABLE_BITS )
+
 // ---------------------------------------------------
 
 static double time_start;
@@ -183,6 +260,12 @@ void next_platform_sleep( double time )
 
 void next_platform_socket_destroy( next_platform_socket_t * socket );
 
+static void next_platform_socket_destroy_io_uring( next_platform_socket_t * socket );
+
+static void next_platform_socket_destroy_xdp( next_platform_socket_t * socket );
+
+int next_platform_socket_receive_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * packet_receive_time, int max_packet_size, int max_packets );
+
 next_platform_socket_t * next_platform_socket_create( void * context, next_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size, bool enable_packet_tagging )
 {
     next_assert( address );
@@ -193,6 +276,13 @@ next_platform_socket_t * next_platform_socket_create( void * context, next_addre
     next_assert( socket );
 
     socket->context = context;
+    socket->udp_segment = false;
+    socket->gro = NULL;
+    socket->uring = NULL;
+    socket->xdp = NULL;
+    socket->busy_poll_microseconds = 0;
+    socket->receive_timestamps = false;
+    memset( &socket->busy_poll_stats, 0, sizeof(socket->busy_poll_stats) );
 
     // create socket
 
@@ -368,253 +458,2020 @@ next_platform_socket_t * next_platform_socket_create( void * context, next_addre
 
 #endif // #if NEXT_PACKET_TAGGING
 
+    // kernel receive timestamps, so jitter and rtt don't include the time packets spent queued before we got to them
+
+    int timestamps = 1;
+    if ( setsockopt( socket->handle, SOL_SOCKET, SO_TIMESTAMPNS, (char*)( &timestamps ), sizeof( int ) ) == 0 )
+    {
+        socket->receive_timestamps = true;
+    }
+    else
+    {
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "failed to enable socket receive timestamps" );
+    }
+
     return socket;
 }
 
 void next_platform_socket_destroy( next_platform_socket_t * socket )
 {
     next_assert( socket );
+    next_platform_socket_destroy_io_uring( socket );
+    next_platform_socket_destroy_xdp( socket );
     if ( socket->handle != 0 )
     {
         close( socket->handle );
     }
+    if ( socket->gro )
+    {
+        next_free( socket->context, socket->gro );
+    }
     next_free( socket->context, socket );
 }
 
-void next_platform_socket_send_packet( next_platform_socket_t * socket, const next_address_t * to, const void * packet_data, int packet_bytes )
+struct next_platform_socket_gro_t
+{
+    uint8_t buffer[NEXT_PLATFORM_GRO_BATCH_SIZE][NEXT_PLATFORM_GRO_BUFFER_BYTES];
+    uint8_t control[NEXT_PLATFORM_GRO_BATCH_SIZE][NEXT_PLATFORM_GRO_CONTROL_BYTES];
+    next_address_t from[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    int message_bytes[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    int segment_bytes[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    double receive_time[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    int num_messages;
+    int message_index;
+    int message_offset;
+};
+
+int next_platform_socket_enable_udp_offload( next_platform_socket_t * socket )
 {
     next_assert( socket );
-    next_assert( to );
-    next_assert( to->type == NEXT_ADDRESS_IPV6 || to->type == NEXT_ADDRESS_IPV4 );
-    next_assert( packet_data );
-    next_assert( packet_bytes > 0 );
 
-    if ( to->type == NEXT_ADDRESS_IPV6 )
+    // IMPORTANT: Setting a zero segment size doesn't segment anything by itself. It just tells us the kernel understands UDP_SEGMENT.
+    // The actual segment size is passed per send with a control message.
+
+    int segment_size = 0;
+    if ( setsockopt( socket->handle, IPPROTO_UDP, UDP_SEGMENT, (char*)( &segment_size ), sizeof( int ) ) == 0 )
     {
-        sockaddr_in6 socket_address;
-        memset( &socket_address, 0, sizeof( socket_address ) );
-        socket_address.sin6_family = AF_INET6;
-        for ( int i = 0; i < 8; ++i )
+        socket->udp_segment = true;
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "enabled udp segmentation offload" );
+    }
+    else
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "udp segmentation offload is not supported: %s", strerror( errno ) );
+    }
+
+    next_platform_socket_gro_t * gro = (next_platform_socket_gro_t*) next_malloc( socket->context, sizeof( next_platform_socket_gro_t ) );
+    if ( gro )
+    {
+        int yes = 1;
+        if ( setsockopt( socket->handle, IPPROTO_UDP, UDP_GRO, (char*)( &yes ), sizeof( int ) ) == 0 )
         {
-            ( (uint16_t*) &socket_address.sin6_addr ) [i] = next_platform_htons( to->data.ipv6[i] );
+            memset( gro, 0, sizeof( next_platform_socket_gro_t ) );
+            socket->gro = gro;
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "enabled udp receive offload" );
         }
-        socket_address.sin6_port = next_platform_htons( to->port );
-        int result = int( sendto( socket->handle, (char*)( packet_data ), packet_bytes, 0, (sockaddr*)( &socket_address ), sizeof(sockaddr_in6) ) );
-        if ( result < 0 )
+        else
         {
-            char address_string[NEXT_MAX_ADDRESS_STRING_LENGTH];
-            next_address_to_string( to, address_string );
-            next_printf( NEXT_LOG_LEVEL_DEBUG, "sendto (%s) failed: %s", address_string, strerror( errno ) );
+            next_printf( NEXT_LOG_LEVEL_WARN, "udp receive offload is not supported: %s", strerror( errno ) );
+            next_free( socket->context, gro );
         }
     }
-    else if ( to->type == NEXT_ADDRESS_IPV4 )
+
+    return ( socket->udp_segment || socket->gro ) ? NEXT_OK : NEXT_ERROR;
+}
+
+// ---------------------------------------------------
+
+// IMPORTANT: AF_XDP runs alongside the regular UDP socket, it doesn't replace it. A small XDP program redirects IPv4 UDP
+// packets for our bound port on the chosen rx queue into the AF_XDP socket. Everything else, including IPv6, fragments and
+// other queues, keeps going through the kernel to the UDP socket. We only transmit through AF_XDP to addresses we have
+// received from, because that is where we learn the MAC addresses and local IP to build the frame. Other destinations
+// and packets larger than a single 1500 byte MTU datagram go through the UDP socket, so the kernel does routing and fragmentation.
+
+struct next_platform_xdp_ring_t
+{
+    uint8_t * map;
+    size_t map_bytes;
+    uint32_t * producer;
+    uint32_t * consumer;
+    uint8_t * descs;
+    uint32_t mask;
+};
+
+struct next_platform_xdp_peer_t
+{
+    uint32_t address;
+    uint32_t local_address;
+    uint8_t peer_mac[6];
+    uint8_t local_mac[6];
+    bool valid;
+};
+
+struct next_platform_socket_xdp_t
+{
+    int xsk_fd;
+    int map_fd;
+    int prog_fd;
+    int link_fd;
+    uint16_t port;
+    int timeout_milliseconds;
+    uint8_t * umem;
+    size_t umem_bytes;
+    next_platform_xdp_ring_t rx;
+    next_platform_xdp_ring_t tx;
+    next_platform_xdp_ring_t fill;
+    next_platform_xdp_ring_t completion;
+    bool mutex_ok;
+    pthread_mutex_t mutex;
+    int num_free_frames;
+    uint64_t free_frames[NEXT_PLATFORM_XDP_NUM_FRAMES];
+    next_platform_xdp_peer_t peers[NEXT_PLATFORM_XDP_PEER_TABLE_SIZE];
+};
+
+static int next_platform_bpf( int command, bpf_attr * attr )
+{
+    return (int) syscall( __NR_bpf, command, attr, sizeof(bpf_attr) );
+}
+
+static int next_platform_xdp_load_program( int map_fd, uint16_t port )
+{
+    // if ( ipv4 && udp && !fragment && ip header is 20 bytes && dest port == port )
+    //     return bpf_redirect_map( xsk_map, ctx->rx_queue_index, XDP_PASS );
+    // return XDP_PASS;
+
+    const int Pass = 23;
+
+    bpf_insn insns[32];
+    memset( insns, 0, sizeof(insns) );
+    int n = 0;
+
+    #define NEXT_BPF_INSN( _code, _dst, _src, _off, _imm )                      \
+    do                                                                          \
+    {                                                                           \
+        insns[n].code = (_code);                                                \
+        insns[n].dst_reg = (_dst);                                              \
+        insns[n].src_reg = (_src);                                              \
+        insns[n].off = (_off);                                                  \
+        insns[n].imm = (_imm);                                                  \
+        n++;                                                                    \
+    } while ( 0 )
+
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof( xdp_md, data ), 0 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof( xdp_md, data_end ), 0 );
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0 );
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, NEXT_PLATFORM_XDP_HEADER_BYTES );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, Pass - n - 1, 0 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 12, 0 );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, Pass - n - 1, next_platform_htons( 0x0800 ) );
+    NEXT_BPF_INSN( BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, 14, 0 );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, Pass - n - 1, 0x45 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_B | BPF_MEM, BPF_REG_5, BPF_REG_2, 23, 0 );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, Pass - n - 1, IPPROTO_UDP );
+    NEXT_BPF_INSN( BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 20, 0 );
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, next_platform_htons( 0x3FFF ) );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, Pass - n - 1, 0 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_H | BPF_MEM, BPF_REG_5, BPF_REG_2, 36, 0 );
+    NEXT_BPF_INSN( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, Pass - n - 1, next_platform_htons( port ) );
+    NEXT_BPF_INSN( BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd );
+    NEXT_BPF_INSN( 0, 0, 0, 0, 0 );
+    NEXT_BPF_INSN( BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_6, offsetof( xdp_md, rx_queue_index ), 0 );
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS );
+    NEXT_BPF_INSN( BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map );
+    NEXT_BPF_INSN( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 );
+    next_assert( n == Pass );
+    NEXT_BPF_INSN( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS );
+    NEXT_BPF_INSN( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 );
+
+    #undef NEXT_BPF_INSN
+
+    static const char license[] = "Dual BSD/GPL";
+
+    char log[4096];
+    log[0] = '\0';
+
+    bpf_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = n;
+    attr.insns = (uint64_t) (uintptr_t) insns;
+    attr.license = (uint64_t) (uintptr_t) license;
+    attr.log_buf = (uint64_t) (uintptr_t) log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+
+    int prog_fd = next_platform_bpf( BPF_PROG_LOAD, &attr );
+    if ( prog_fd < 0 )
     {
-        sockaddr_in socket_address;
-        memset( &socket_address, 0, sizeof( socket_address ) );
-        socket_address.sin_family = AF_INET;
-        socket_address.sin_addr.s_addr = ( ( (uint32_t) to->data.ipv4[0] ) )        | 
-                                         ( ( (uint32_t) to->data.ipv4[1] ) << 8 )   | 
-                                         ( ( (uint32_t) to->data.ipv4[2] ) << 16 )  | 
-                                         ( ( (uint32_t) to->data.ipv4[3] ) << 24 );
-        socket_address.sin_port = next_platform_htons( to->port );
-        int result = int( sendto( socket->handle, (const char*)( packet_data ), packet_bytes, 0, (sockaddr*)( &socket_address ), sizeof(sockaddr_in) ) );
-        if ( result < 0 )
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "xdp program load failed: %s\n%s", strerror( errno ), log );
+    }
+
+    return prog_fd;
+}
+
+static bool next_platform_xdp_map_ring( int xsk_fd, next_platform_xdp_ring_t * ring, const xdp_ring_offset & offsets, size_t desc_bytes, off_t page_offset )
+{
+    ring->map_bytes = offsets.desc + NEXT_PLATFORM_XDP_RING_SIZE * desc_bytes;
+    void * p = mmap( NULL, ring->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd, page_offset );
+    if ( p == MAP_FAILED )
+        return false;
+    ring->map = (uint8_t*) p;
+    ring->producer = (uint32_t*) ( ring->map + offsets.producer );
+    ring->consumer = (uint32_t*) ( ring->map + offsets.consumer );
+    ring->descs = ring->map + offsets.desc;
+    ring->mask = NEXT_PLATFORM_XDP_RING_SIZE - 1;
+    return true;
+}
+
+static void next_platform_socket_free_xdp( void * context, next_platform_socket_xdp_t * xdp )
+{
+    // closing the link detaches the program from the interface, so do that before anything else goes away
+
+    if ( xdp->link_fd >= 0 )
+    {
+        close( xdp->link_fd );
+    }
+    if ( xdp->prog_fd >= 0 )
+    {
+        close( xdp->prog_fd );
+    }
+    if ( xdp->map_fd >= 0 )
+    {
+        close( xdp->map_fd );
+    }
+    next_platform_xdp_ring_t * rings[] = { &xdp->rx, &xdp->tx, &xdp->fill, &xdp->completion };
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( rings[i]->map )
         {
-            char address_string[NEXT_MAX_ADDRESS_STRING_LENGTH];
-            next_address_to_string( to, address_string );
-            next_printf( NEXT_LOG_LEVEL_DEBUG, "sendto (%s) failed: %s", address_string, strerror( errno ) );
+            munmap( rings[i]->map, rings[i]->map_bytes );
         }
     }
-    else
+    if ( xdp->xsk_fd >= 0 )
     {
-        next_printf( NEXT_LOG_LEVEL_ERROR, "invalid address type. could not send packet" );
+        close( xdp->xsk_fd );
+    }
+    if ( xdp->umem )
+    {
+        munmap( xdp->umem, xdp->umem_bytes );
+    }
+    if ( xdp->mutex_ok )
+    {
+        pthread_mutex_destroy( &xdp->mutex );
     }
+    next_free( context, xdp );
 }
 
-void next_platform_socket_send_packets( next_platform_socket_t * socket, const next_address_t * to, void ** packet_data, int * packet_bytes, int num_packets )
+static int next_platform_socket_create_xdp( next_platform_socket_t * socket, next_platform_socket_xdp_t * xdp, const char * interface_name, int queue_id )
 {
-    next_assert( socket );
-    next_assert( to );
-    next_assert( packet_data );
-    next_assert( packet_bytes );
-    next_assert( num_packets >= 0 );
-
-    if ( num_packets == 0 )
-        return;
-
-    iovec * msg = (iovec*) alloca( sizeof(iovec) * num_packets );
+    // IMPORTANT: net/if.h clashes with linux/if.h, which linux/wireless.h pulls in, so look up the index with an ioctl instead of if_nametoindex
 
-    for ( int i = 0; i < num_packets; ++i )
+    ifreq interface_request;
+    memset( &interface_request, 0, sizeof(interface_request) );
+    strncpy( interface_request.ifr_name, interface_name, IFNAMSIZ - 1 );
+    const int interface_index = ( ioctl( socket->handle, SIOCGIFINDEX, &interface_request ) == 0 ) ? interface_request.ifr_ifindex : 0;
+    if ( interface_index == 0 )
     {
-        msg[i].iov_base = packet_data[i];
-        msg[i].iov_len = packet_bytes[i];
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not find network interface '%s'", interface_name );
+        return NEXT_ERROR;
     }
 
-    sockaddr_in * socket_address = (sockaddr_in*) alloca( sizeof(sockaddr_in) * num_packets );
+    sockaddr_storage bound_address;
+    socklen_t bound_address_length = sizeof(bound_address);
+    if ( getsockname( socket->handle, (sockaddr*) &bound_address, &bound_address_length ) != 0 || bound_address.ss_family != AF_INET )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "af_xdp needs an ipv4 socket" );
+        return NEXT_ERROR;
+    }
+    xdp->port = next_platform_ntohs( ( (sockaddr_in*) &bound_address )->sin_port );
 
-    for ( int i = 0; i < num_packets; ++i )
+    struct timeval tv;
+    memset( &tv, 0, sizeof(tv) );
+    socklen_t tv_length = sizeof(tv);
+    xdp->timeout_milliseconds = -1;
+    if ( getsockopt( socket->handle, SOL_SOCKET, SO_RCVTIMEO, &tv, &tv_length ) == 0 && ( tv.tv_sec > 0 || tv.tv_usec > 0 ) )
     {
-        next_assert( to[i].type == NEXT_ADDRESS_IPV4 );                 // note: ipv6 not supported
-        memset( &socket_address[i], 0, sizeof(sockaddr_in) );
-        socket_address[i].sin_family = AF_INET;
-        socket_address[i].sin_addr.s_addr = ( ( (uint32_t) to[i].data.ipv4[0] ) )        | 
-                                            ( ( (uint32_t) to[i].data.ipv4[1] ) << 8 )   | 
-                                            ( ( (uint32_t) to[i].data.ipv4[2] ) << 16 )  | 
-                                            ( ( (uint32_t) to[i].data.ipv4[3] ) << 24 );
-        socket_address[i].sin_port = next_platform_htons( to->port );
+        xdp->timeout_milliseconds = int( tv.tv_sec * 1000 + ( tv.tv_usec + 999 ) / 1000 );
     }
 
-    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * num_packets );
+    if ( pthread_mutex_init( &xdp->mutex, NULL ) != 0 )
+        return NEXT_ERROR;
+    xdp->mutex_ok = true;
 
-    for ( int i = 0; i < num_packets; ++i )
+    // umem, with the first half of the frames given to the kernel for receive and the second half kept for transmit
+
+    xdp->umem_bytes = size_t( NEXT_PLATFORM_XDP_NUM_FRAMES ) * NEXT_PLATFORM_XDP_FRAME_BYTES;
+    void * umem = mmap( NULL, xdp->umem_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( umem == MAP_FAILED )
     {
-        packet_array[i].msg_hdr.msg_name = &socket_address[i];
-        packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
-        packet_array[i].msg_hdr.msg_iov = &msg[i];
-        packet_array[i].msg_hdr.msg_iovlen = 1;
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not map af_xdp umem" );
+        return NEXT_ERROR;
     }
+    xdp->umem = (uint8_t*) umem;
 
-    int result = sendmmsg( socket->handle, packet_array, num_packets, 0 );
-    
-    if ( result == -1 )
+    xdp->xsk_fd = ::socket( AF_XDP, SOCK_RAW, 0 );
+    if ( xdp->xsk_fd < 0 )
     {
-        next_printf( NEXT_LOG_LEVEL_ERROR, "sendmmsg failed to send packets" );
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not create af_xdp socket: %s", strerror( errno ) );
+        return NEXT_ERROR;
     }
-}
 
-int next_platform_socket_receive_packet( next_platform_socket_t * socket, next_address_t * from, void * packet_data, int max_packet_size )
-{
-    next_assert( socket );
-    next_assert( from );
-    next_assert( packet_data );
-    next_assert( max_packet_size > 0 );
+    xdp_umem_reg umem_reg;
+    memset( &umem_reg, 0, sizeof(umem_reg) );
+    umem_reg.addr = (uint64_t) (uintptr_t) xdp->umem;
+    umem_reg.len = xdp->umem_bytes;
+    umem_reg.chunk_size = NEXT_PLATFORM_XDP_FRAME_BYTES;
+    if ( setsockopt( xdp->xsk_fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg) ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not register af_xdp umem: %s", strerror( errno ) );
+        return NEXT_ERROR;
+    }
 
-    sockaddr_storage sockaddr_from;
-    socklen_t from_length = sizeof( sockaddr_from );
+    const int ring_size = NEXT_PLATFORM_XDP_RING_SIZE;
+    if ( setsockopt( xdp->xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(int) ) != 0 ||
+         setsockopt( xdp->xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(int) ) != 0 ||
+         setsockopt( xdp->xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(int) ) != 0 ||
+         setsockopt( xdp->xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(int) ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not size af_xdp rings: %s", strerror( errno ) );
+        return NEXT_ERROR;
+    }
 
-    int result = int( recvfrom( socket->handle, (char*) packet_data, max_packet_size, socket->type == NEXT_PLATFORM_SOCKET_NON_BLOCKING ? MSG_DONTWAIT : 0, (sockaddr*) &sockaddr_from, &from_length ) );
+    xdp_mmap_offsets offsets;
+    socklen_t offsets_length = sizeof(offsets);
+    if ( getsockopt( xdp->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_length ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not get af_xdp ring offsets: %s", strerror( errno ) );
+        return NEXT_ERROR;
+    }
 
-    if ( result <= 0 )
+    if ( !next_platform_xdp_map_ring( xdp->xsk_fd, &xdp->rx, offsets.rx, sizeof(xdp_desc), XDP_PGOFF_RX_RING ) ||
+         !next_platform_xdp_map_ring( xdp->xsk_fd, &xdp->tx, offsets.tx, sizeof(xdp_desc), XDP_PGOFF_TX_RING ) ||
+         !next_platform_xdp_map_ring( xdp->xsk_fd, &xdp->fill, offsets.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING ) ||
+         !next_platform_xdp_map_ring( xdp->xsk_fd, &xdp->completion, offsets.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING ) )
     {
-        if ( errno == EAGAIN || errno == EINTR )
-        {
-            return 0;
-        }
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not map af_xdp rings: %s", strerror( errno ) );
+        return NEXT_ERROR;
+    }
 
-        next_printf( NEXT_LOG_LEVEL_DEBUG, "recvfrom failed with error %d", errno );
-        
-        return 0;
+    for ( int i = 0; i < NEXT_PLATFORM_XDP_RING_SIZE; ++i )
+    {
+        ( (uint64_t*) xdp->fill.descs )[i] = uint64_t( i ) * NEXT_PLATFORM_XDP_FRAME_BYTES;
     }
+    __atomic_store_n( xdp->fill.producer, uint32_t( NEXT_PLATFORM_XDP_RING_SIZE ), __ATOMIC_RELEASE );
 
-    if ( sockaddr_from.ss_family == AF_INET6 )
+    for ( int i = NEXT_PLATFORM_XDP_RING_SIZE; i < NEXT_PLATFORM_XDP_NUM_FRAMES; ++i )
     {
-        sockaddr_in6 * addr_ipv6 = (sockaddr_in6*) &sockaddr_from;
-        from->type = NEXT_ADDRESS_IPV6;
-        for ( int i = 0; i < 8; ++i )
-        {
-            from->data.ipv6[i] = next_platform_ntohs( ( (uint16_t*) &addr_ipv6->sin6_addr ) [i] );
-        }
-        from->port = next_platform_ntohs( addr_ipv6->sin6_port );
+        xdp->free_frames[xdp->num_free_frames++] = uint64_t( i ) * NEXT_PLATFORM_XDP_FRAME_BYTES;
     }
-    else if ( sockaddr_from.ss_family == AF_INET )
+
+    // xsk map and program. the program is only attached once the socket is bound and in the map
+
+    bpf_attr attr;
+    memset( &attr, 0, sizeof(attr) );
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = NEXT_PLATFORM_XDP_MAX_QUEUES;
+    xdp->map_fd = next_platform_bpf( BPF_MAP_CREATE, &attr );
+    if ( xdp->map_fd < 0 )
     {
-        sockaddr_in * addr_ipv4 = (sockaddr_in*) &sockaddr_from;
-        from->type = NEXT_ADDRESS_IPV4;
-        from->data.ipv4[0] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x000000FF ) );
-        from->data.ipv4[1] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x0000FF00 ) >> 8 );
-        from->data.ipv4[2] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x00FF0000 ) >> 16 );
-        from->data.ipv4[3] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0xFF000000 ) >> 24 );
-        from->port = next_platform_ntohs( addr_ipv4->sin_port );
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not create xsk map: %s", strerror( errno ) );
+        return NEXT_ERROR;
     }
-    else
+
+    xdp->prog_fd = next_platform_xdp_load_program( xdp->map_fd, xdp->port );
+    if ( xdp->prog_fd < 0 )
     {
-        next_assert( 0 );
-        return 0;
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not load xdp program: %s", strerror( errno ) );
+        return NEXT_ERROR;
     }
-  
-    next_assert( result >= 0 );
 
-    return result;
-}
+    // prefer the driver's native xdp, which allows zero copy. otherwise use generic (skb) mode, which works on any interface, including veth and lo
 
-// ---------------------------------------------------
+    bool native = true;
 
-next_platform_thread_t * next_platform_thread_create( void * context, next_platform_thread_func_t * thread_function, void * arg )
-{
-    next_platform_thread_t * thread = (next_platform_thread_t*) next_malloc( context, sizeof( next_platform_thread_t) );
+    memset( &attr, 0, sizeof(attr) );
+    attr.link_create.prog_fd = xdp->prog_fd;
+    attr.link_create.target_ifindex = interface_index;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+    xdp->link_fd = next_platform_bpf( BPF_LINK_CREATE, &attr );
+    if ( xdp->link_fd < 0 )
+    {
+        native = false;
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        xdp->link_fd = next_platform_bpf( BPF_LINK_CREATE, &attr );
+    }
+    if ( xdp->link_fd < 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not attach xdp program to '%s': %s", interface_name, strerror( errno ) );
+        return NEXT_ERROR;
+    }
 
-    next_assert( thread );
+    sockaddr_xdp xdp_address;
+    memset( &xdp_address, 0, sizeof(xdp_address) );
+    xdp_address.sxdp_family = AF_XDP;
+    xdp_address.sxdp_ifindex = interface_index;
+    xdp_address.sxdp_queue_id = queue_id;
+    xdp_address.sxdp_flags = native ? XDP_ZEROCOPY : XDP_COPY;
+    if ( bind( xdp->xsk_fd, (sockaddr*) &xdp_address, sizeof(xdp_address) ) != 0 )
+    {
+        native = false;
+        xdp_address.sxdp_flags = XDP_COPY;
+        if ( bind( xdp->xsk_fd, (sockaddr*) &xdp_address, sizeof(xdp_address) ) != 0 )
+        {
+            next_printf( NEXT_LOG_LEVEL_WARN, "could not bind af_xdp socket to '%s' queue %d: %s", interface_name, queue_id, strerror( errno ) );
+            return NEXT_ERROR;
+        }
+    }
 
-    thread->context = context;
-    
-    if ( pthread_create( &thread->handle, NULL, thread_function, arg ) != 0 )
+    uint32_t key = uint32_t( queue_id );
+    uint32_t value = uint32_t( xdp->xsk_fd );
+    memset( &attr, 0, sizeof(attr) );
+    attr.map_fd = xdp->map_fd;
+    attr.key = (uint64_t) (uintptr_t) &key;
+    attr.value = (uint64_t) (uintptr_t) &value;
+    if ( next_platform_bpf( BPF_MAP_UPDATE_ELEM, &attr ) != 0 )
     {
-        next_free( context, thread );
-        return NULL;
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not add af_xdp socket to xsk map: %s", strerror( errno ) );
+        return NEXT_ERROR;
     }
 
-    return thread;
-}
+    next_printf( NEXT_LOG_LEVEL_DEBUG, "af_xdp socket bound to '%s' queue %d (%s)", interface_name, queue_id, native ? "zero copy" : "copy" );
 
-void next_platform_thread_join( next_platform_thread_t * thread )
-{
-    next_assert( thread );
-    pthread_join( thread->handle, NULL );
+    return NEXT_OK;
 }
 
-void next_platform_thread_destroy( next_platform_thread_t * thread )
+int next_platform_socket_enable_xdp( next_platform_socket_t * socket, const char * interface_name, int queue_id )
 {
-    next_assert( thread );
-    next_free( thread->context, thread );
-}
+    next_assert( socket );
+    next_assert( interface_name );
+    next_assert( queue_id >= 0 );
 
-bool next_platform_thread_high_priority( next_platform_thread_t * thread )
-{
-    struct sched_param param;
-    param.sched_priority = sched_get_priority_max( SCHED_FIFO );
-    return pthread_setschedparam( thread->handle, SCHED_FIFO, &param ) == 0;
-}
+    if ( socket->xdp )
+        return NEXT_OK;
 
-// ---------------------------------------------------
+    if ( queue_id >= NEXT_PLATFORM_XDP_MAX_QUEUES )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "af_xdp queue %d is out of range", queue_id );
+        return NEXT_ERROR;
+    }
 
-int next_platform_mutex_create( next_platform_mutex_t * mutex )
-{
-    next_assert( mutex );
+    next_platform_socket_xdp_t * xdp = (next_platform_socket_xdp_t*) next_malloc( socket->context, sizeof( next_platform_socket_xdp_t ) );
+    if ( !xdp )
+        return NEXT_ERROR;
 
-    memset( mutex, 0, sizeof(next_platform_mutex_t) );
-    
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init( &attr );
-    pthread_mutexattr_settype( &attr, 0 );
-    int result = pthread_mutex_init( &mutex->handle, &attr );
-    pthread_mutexattr_destroy( &attr );
+    memset( xdp, 0, sizeof( next_platform_socket_xdp_t ) );
+    xdp->xsk_fd = -1;
+    xdp->map_fd = -1;
+    xdp->prog_fd = -1;
+    xdp->link_fd = -1;
 
-    if ( result != 0 )
+    if ( next_platform_socket_create_xdp( socket, xdp, interface_name, queue_id ) != NEXT_OK )
+    {
+        next_platform_socket_free_xdp( socket->context, xdp );
         return NEXT_ERROR;
+    }
 
-    mutex->ok = true;
+    // packets that don't go through af_xdp are picked up from the udp socket with plain recvmmsg
+
+    next_platform_socket_destroy_io_uring( socket );
+
+    if ( socket->gro )
+    {
+        int no = 0;
+        setsockopt( socket->handle, IPPROTO_UDP, UDP_GRO, (char*)( &no ), sizeof( int ) );
+        next_free( socket->context, socket->gro );
+        socket->gro = NULL;
+    }
+
+    socket->xdp = xdp;
 
     return NEXT_OK;
 }
 
-void next_platform_mutex_acquire( next_platform_mutex_t * mutex )
+static void next_platform_socket_destroy_xdp( next_platform_socket_t * socket )
 {
-    next_assert( mutex );
-    next_assert( mutex->ok );
-    pthread_mutex_lock( &mutex->handle );
+    if ( socket->xdp )
+    {
+        next_platform_socket_free_xdp( socket->context, socket->xdp );
+        socket->xdp = NULL;
+    }
 }
 
-void next_platform_mutex_release( next_platform_mutex_t * mutex )
+static int next_platform_socket_receive_xdp_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, int max_packet_size, int max_packets )
 {
-    next_assert( mutex );
-    next_assert( mutex->ok );
-    pthread_mutex_unlock( &mutex->handle );
-}
+    next_platform_socket_xdp_t * xdp = socket->xdp;
 
-void next_platform_mutex_destroy( next_platform_mutex_t * mutex )
-{
-    next_assert( mutex );
-    if ( mutex->ok )
+    next_assert( xdp );
+
+    uint32_t rx_consumer = *xdp->rx.consumer;
+    const uint32_t rx_producer = __atomic_load_n( xdp->rx.producer, __ATOMIC_ACQUIRE );
+
+    if ( rx_consumer == rx_producer )
+        return 0;
+
+    uint32_t fill_producer = *xdp->fill.producer;
+
+    int num_packets = 0;
+
+    pthread_mutex_lock( &xdp->mutex );
+
+    while ( rx_consumer != rx_producer && num_packets < max_packets )
+    {
+        const xdp_desc * desc = ( (const xdp_desc*) xdp->rx.descs ) + ( rx_consumer & xdp->rx.mask );
+
+        const uint8_t * frame = xdp->umem + desc->addr;
+
+        // the program has already checked ethernet, ipv4, udp and the port. check the lengths before trusting them
+
+        const int ip_bytes = ( int( frame[16] ) << 8 ) | frame[17];
+        const int udp_bytes = ( int( frame[38] ) << 8 ) | frame[39];
+        const int bytes = udp_bytes - 8;
+
+        if ( desc->len >= NEXT_PLATFORM_XDP_HEADER_BYTES && ip_bytes >= 28 && 14 + ip_bytes <= int( desc->len ) && udp_bytes >= 8 && udp_bytes <= ip_bytes - 20 && bytes <= max_packet_size )
+        {
+            next_address_t * address = &from[num_packets];
+            memset( address, 0, sizeof(next_address_t) );
+            address->type = NEXT_ADDRESS_IPV4;
+            memcpy( address->data.ipv4, frame + 26, 4 );
+            address->port = uint16_t( ( int( frame[34] ) << 8 ) | frame[35] );
+
+            memcpy( packet_data[num_packets], frame + NEXT_PLATFORM_XDP_HEADER_BYTES, bytes );
+            packet_bytes[num_packets] = bytes;
+            num_packets++;
+
+            // remember how to reach this address, so replies to it can go out through af_xdp too
+
+            uint32_t peer_address;
+            memcpy( &peer_address, frame + 26, 4 );
+            next_platform_xdp_peer_t * peer = &xdp->peers[( peer_address * 2654435761U ) >> ( 32 - NEXT_PLATFORM_XDP_PEER_TABLE_BITS )];
+            peer->address = peer_address;
+            memcpy( &peer->local_address, frame + 30, 4 );
+            memcpy( peer->peer_mac, frame + 6, 6 );
+            memcpy( peer->local_mac, frame, 6 );
+            peer->valid = true;
+        }
+
+        ( (uint64_t*) xdp->fill.descs )[fill_producer & xdp->fill.mask] = desc->addr & ~uint64_t( NEXT_PLATFORM_XDP_FRAME_BYTES - 1 );
+
+        fill_producer++;
+        rx_consumer++;
+    }
+
+    pthread_mutex_unlock( &xdp->mutex );
+
+    __atomic_store_n( xdp->fill.producer, fill_producer, __ATOMIC_RELEASE );
+    __atomic_store_n( xdp->rx.consumer, rx_consumer, __ATOMIC_RELEASE );
+
+    return num_packets;
+}
+
+static void next_platform_xdp_write_frame( uint8_t * frame, const next_platform_xdp_peer_t * peer, uint16_t from_port, const next_address_t * to, const uint8_t * packet_data, int packet_bytes )
+{
+    memcpy( frame, peer->peer_mac, 6 );
+    memcpy( frame + 6, peer->local_mac, 6 );
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    uint8_t * ip = frame + 14;
+    const int ip_bytes = 20 + 8 + packet_bytes;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[2] = uint8_t( ip_bytes >> 8 );
+    ip[3] = uint8_t( ip_bytes );
+    ip[4] = 0;
+    ip[5] = 0;
+    ip[6] = 0x40;
+    ip[7] = 0;
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    ip[10] = 0;
+    ip[11] = 0;
+    memcpy( ip + 12, &peer->local_address, 4 );
+    memcpy( ip + 16, to->data.ipv4, 4 );
+
+    uint32_t sum = 0;
+    for ( int i = 0; i < 20; i += 2 )
+    {
+        sum += ( uint32_t( ip[i] ) << 8 ) | ip[i+1];
+    }
+    while ( sum >> 16 )
+    {
+        sum = ( sum & 0xFFFF ) + ( sum >> 16 );
+    }
+    const uint16_t checksum = uint16_t( ~sum );
+    ip[10] = uint8_t( checksum >> 8 );
+    ip[11] = uint8_t( checksum );
+
+    // a zero udp checksum means "no checksum" over ipv4, same as the kernel sends with SO_NO_CHECK
+
+    uint8_t * udp = ip + 20;
+    const int udp_bytes = 8 + packet_bytes;
+    udp[0] = uint8_t( from_port >> 8 );
+    udp[1] = uint8_t( from_port );
+    udp[2] = uint8_t( to->port >> 8 );
+    udp[3] = uint8_t( to->port );
+    udp[4] = uint8_t( udp_bytes >> 8 );
+    udp[5] = uint8_t( udp_bytes );
+    udp[6] = 0;
+    udp[7] = 0;
+
+    memcpy( udp + 8, packet_data, packet_bytes );
+}
+
+static int next_platform_socket_send_xdp_packets( next_platform_socket_t * socket, const next_address_t * to, uint8_t ** packet_data, int * packet_bytes, int num_packets, bool * sent )
+{
+    next_platform_socket_xdp_t * xdp = socket->xdp;
+
+    next_assert( xdp );
+
+    int num_sent = 0;
+
+    pthread_mutex_lock( &xdp->mutex );
+
+    // take back frames the kernel has finished sending
+
+    uint32_t completion_consumer = *xdp->completion.consumer;
+    const uint32_t completion_producer = __atomic_load_n( xdp->completion.producer, __ATOMIC_ACQUIRE );
+    while ( completion_consumer != completion_producer )
+    {
+        next_assert( xdp->num_free_frames < NEXT_PLATFORM_XDP_NUM_FRAMES );
+        xdp->free_frames[xdp->num_free_frames++] = ( (const uint64_t*) xdp->completion.descs )[completion_consumer & xdp->completion.mask];
+        completion_consumer++;
+    }
+    __atomic_store_n( xdp->completion.consumer, completion_consumer, __ATOMIC_RELEASE );
+
+    uint32_t tx_producer = *xdp->tx.producer;
+    const uint32_t tx_consumer = __atomic_load_n( xdp->tx.consumer, __ATOMIC_ACQUIRE );
+
+    for ( int i = 0; i < num_packets; ++i )
+    {
+        sent[i] = false;
+
+        // IMPORTANT: Frames built by af_xdp carry no route, so the kernel drops anything to 127.0.0.0/8 as a martian destination
+        // unless route_localnet is set. Loopback traffic gains nothing from af_xdp anyway, so it stays on the udp socket.
+
+        if ( to[i].type != NEXT_ADDRESS_IPV4 || to[i].data.ipv4[0] == 127 || packet_bytes[i] > NEXT_PLATFORM_XDP_MAX_PAYLOAD_BYTES )
+            continue;
+
+        if ( xdp->num_free_frames == 0 || tx_producer - tx_consumer >= NEXT_PLATFORM_XDP_RING_SIZE )
+            continue;
+
+        uint32_t peer_address;
+        memcpy( &peer_address, to[i].data.ipv4, 4 );
+        const next_platform_xdp_peer_t * peer = &xdp->peers[( peer_address * 2654435761U ) >> ( 32 - NEXT_PLATFORM_XDP_PEER_TABLE_BITS )];
+        if ( !peer->valid || peer->address != peer_address )
+            continue;
+
+        const uint64_t frame_address = xdp->free_frames[--xdp->num_free_frames];
+
+        next_platform_xdp_write_frame( xdp->umem + frame_address, peer, xdp->port, &to[i], packet_data[i], packet_bytes[i] );
+
+        xdp_desc * desc = ( (xdp_desc*) xdp->tx.descs ) + ( tx_producer & xdp->tx.mask );
+        desc->addr = frame_address;
+        desc->len = NEXT_PLATFORM_XDP_HEADER_BYTES + packet_bytes[i];
+        desc->options = 0;
+
+        tx_producer++;
+
+        sent[i] = true;
+        num_sent++;
+    }
+
+    if ( num_sent > 0 )
+    {
+        __atomic_store_n( xdp->tx.producer, tx_producer, __ATOMIC_RELEASE );
+
+        // IMPORTANT: af_xdp transmit always needs a kick. In copy mode the frames are sent right here in the syscall, but only
+        // a limited batch per call, with EAGAIN meaning there is more to do. Keep kicking until the kernel has taken them all.
+
+        for ( int i = 0; i < NEXT_PLATFORM_XDP_RING_SIZE; ++i )
+        {
+            if ( sendto( xdp->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0 ) >= 0 )
+                break;
+
+            if ( errno != EAGAIN && errno != EBUSY )
+            {
+                if ( errno != ENOBUFS && errno != ENETDOWN )
+                {
+                    next_printf( NEXT_LOG_LEVEL_DEBUG, "af_xdp transmit kick failed: %s", strerror( errno ) );
+                }
+                break;
+            }
+
+            if ( __atomic_load_n( xdp->tx.consumer, __ATOMIC_ACQUIRE ) == tx_producer )
+                break;
+        }
+    }
+
+    pthread_mutex_unlock( &xdp->mutex );
+
+    return num_sent;
+}
+
+void next_platform_socket_send_packet( next_platform_socket_t * socket, const next_address_t * to, const void * packet_data, int packet_bytes )
+{
+    next_assert( socket );
+    next_assert( to );
+    next_assert( to->type == NEXT_ADDRESS_IPV6 || to->type == NEXT_ADDRESS_IPV4 );
+    next_assert( packet_data );
+    next_assert( packet_bytes > 0 );
+
+    if ( socket->xdp )
+    {
+        uint8_t * packet_data_array[1] = { (uint8_t*) packet_data };
+        bool sent = false;
+        if ( next_platform_socket_send_xdp_packets( socket, to, packet_data_array, &packet_bytes, 1, &sent ) )
+            return;
+    }
+
+    if ( to->type == NEXT_ADDRESS_IPV6 )
+    {
+        sockaddr_in6 socket_address;
+        memset( &socket_address, 0, sizeof( socket_address ) );
+        socket_address.sin6_family = AF_INET6;
+        for ( int i = 0; i < 8; ++i )
+        {
+            ( (uint16_t*) &socket_address.sin6_addr ) [i] = next_platform_htons( to->data.ipv6[i] );
+        }
+        socket_address.sin6_port = next_platform_htons( to->port );
+        int result = int( sendto( socket->handle, (char*)( packet_data ), packet_bytes, 0, (sockaddr*)( &socket_address ), sizeof(sockaddr_in6) ) );
+        if ( result < 0 )
+        {
+            char address_string[NEXT_MAX_ADDRESS_STRING_LENGTH];
+            next_address_to_string( to, address_string );
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "sendto (%s) failed: %s", address_string, strerror( errno ) );
+        }
+    }
+    else if ( to->type == NEXT_ADDRESS_IPV4 )
+    {
+        sockaddr_in socket_address;
+        memset( &socket_address, 0, sizeof( socket_address ) );
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_addr.s_addr = ( ( (uint32_t) to->data.ipv4[0] ) )        | 
+                                         ( ( (uint32_t) to->data.ipv4[1] ) << 8 )   | 
+                                         ( ( (uint32_t) to->data.ipv4[2] ) << 16 )  | 
+                                         ( ( (uint32_t) to->data.ipv4[3] ) << 24 );
+        socket_address.sin_port = next_platform_htons( to->port );
+        int result = int( sendto( socket->handle, (const char*)( packet_data ), packet_bytes, 0, (sockaddr*)( &socket_address ), sizeof(sockaddr_in) ) );
+        if ( result < 0 )
+        {
+            char address_string[NEXT_MAX_ADDRESS_STRING_LENGTH];
+            next_address_to_string( to, address_string );
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "sendto (%s) failed: %s", address_string, strerror( errno ) );
+        }
+    }
+    else
+    {
+        next_printf( NEXT_LOG_LEVEL_ERROR, "invalid address type. could not send packet" );
+    }
+}
+
+static void next_platform_socket_send_packets_internal( next_platform_socket_t * socket, const next_address_t * to, uint8_t ** packet_data, int * packet_bytes, int num_packets, bool udp_segment )
+{
+    next_assert( socket );
+    next_assert( to );
+    next_assert( packet_data );
+    next_assert( packet_bytes );
+    next_assert( num_packets >= 0 );
+
+    if ( num_packets == 0 )
+        return;
+
+    iovec * msg = (iovec*) alloca( sizeof(iovec) * num_packets );
+
+    sockaddr_storage * socket_address = (sockaddr_storage*) alloca( sizeof(sockaddr_storage) * num_packets );
+
+    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * num_packets );
+
+    int * message_first_packet = (int*) alloca( sizeof(int) * num_packets );
+
+    uint8_t * control = udp_segment ? (uint8_t*) alloca( CMSG_SPACE( sizeof(uint16_t) ) * num_packets ) : NULL;
+
+    int num_messages = 0;
+
+    int i = 0;
+
+    while ( i < num_packets )
+    {
+        socklen_t socket_address_length = 0;
+
+        memset( &socket_address[num_messages], 0, sizeof(sockaddr_storage) );
+
+        if ( to[i].type == NEXT_ADDRESS_IPV6 )
+        {
+            sockaddr_in6 * address_ipv6 = (sockaddr_in6*) &socket_address[num_messages];
+            address_ipv6->sin6_family = AF_INET6;
+            for ( int j = 0; j < 8; ++j )
+            {
+                ( (uint16_t*) &address_ipv6->sin6_addr ) [j] = next_platform_htons( to[i].data.ipv6[j] );
+            }
+            address_ipv6->sin6_port = next_platform_htons( to[i].port );
+            socket_address_length = sizeof(sockaddr_in6);
+        }
+        else if ( to[i].type == NEXT_ADDRESS_IPV4 )
+        {
+            sockaddr_in * address_ipv4 = (sockaddr_in*) &socket_address[num_messages];
+            address_ipv4->sin_family = AF_INET;
+            address_ipv4->sin_addr.s_addr = ( ( (uint32_t) to[i].data.ipv4[0] ) )        | 
+                                            ( ( (uint32_t) to[i].data.ipv4[1] ) << 8 )   | 
+                                            ( ( (uint32_t) to[i].data.ipv4[2] ) << 16 )  | 
+                                            ( ( (uint32_t) to[i].data.ipv4[3] ) << 24 );
+            address_ipv4->sin_port = next_platform_htons( to[i].port );
+            socket_address_length = sizeof(sockaddr_in);
+        }
+        else
+        {
+            next_printf( NEXT_LOG_LEVEL_ERROR, "invalid address type. could not send packet" );
+            i++;
+            continue;
+        }
+
+        // with udp segmentation offload, a run of packets to the same address is sent as one message. 
+        // every packet in the run must be the segment size, except the last which may be smaller.
+
+        int num_segments = 1;
+
+        if ( udp_segment && packet_bytes[i] <= NEXT_PLATFORM_GSO_MAX_SEGMENT_BYTES )
+        {
+            int total_bytes = packet_bytes[i];
+            while ( i + num_segments < num_packets && num_segments < NEXT_PLATFORM_GSO_MAX_SEGMENTS )
+            {
+                const int j = i + num_segments;
+                if ( packet_bytes[j-1] != packet_bytes[i] || packet_bytes[j] > packet_bytes[i] || total_bytes + packet_bytes[j] > NEXT_PLATFORM_GSO_MAX_BYTES )
+                    break;
+                if ( !next_address_equal( &to[i], &to[j] ) )
+                    break;
+                total_bytes += packet_bytes[j];
+                num_segments++;
+            }
+        }
+
+        for ( int j = 0; j < num_segments; ++j )
+        {
+            msg[i+j].iov_base = packet_data[i+j];
+            msg[i+j].iov_len = packet_bytes[i+j];
+        }
+
+        memset( &packet_array[num_messages], 0, sizeof(mmsghdr) );
+
+        packet_array[num_messages].msg_hdr.msg_name = &socket_address[num_messages];
+        packet_array[num_messages].msg_hdr.msg_namelen = socket_address_length;
+        packet_array[num_messages].msg_hdr.msg_iov = &msg[i];
+        packet_array[num_messages].msg_hdr.msg_iovlen = num_segments;
+
+        if ( num_segments > 1 )
+        {
+            uint8_t * message_control = control + CMSG_SPACE( sizeof(uint16_t) ) * num_messages;
+            memset( message_control, 0, CMSG_SPACE( sizeof(uint16_t) ) );
+            packet_array[num_messages].msg_hdr.msg_control = message_control;
+            packet_array[num_messages].msg_hdr.msg_controllen = CMSG_SPACE( sizeof(uint16_t) );
+            cmsghdr * cmsg = CMSG_FIRSTHDR( &packet_array[num_messages].msg_hdr );
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN( sizeof(uint16_t) );
+            const uint16_t segment_bytes = uint16_t( packet_bytes[i] );
+            memcpy( CMSG_DATA( cmsg ), &segment_bytes, sizeof(uint16_t) );
+        }
+
+        message_first_packet[num_messages] = i;
+
+        num_messages++;
+
+        i += num_segments;
+    }
+
+    // IMPORTANT: sendmmsg stops at the first packet that fails and returns how many were sent before it.
+    // Skip the failed packet and keep going, so one bad destination doesn't drop the rest of the batch.
+
+    int num_sent = 0;
+
+    while ( num_sent < num_messages )
+    {
+        int result = sendmmsg( socket->handle, packet_array + num_sent, num_messages - num_sent, 0 );
+
+        if ( result < 0 && errno == EINTR )
+            continue;
+
+        if ( result <= 0 )
+        {
+            if ( packet_array[num_sent].msg_hdr.msg_iovlen > 1 )
+            {
+                // the kernel rejected a segmented send. resend everything from here on as individual packets
+
+                if ( errno == EIO || errno == EOPNOTSUPP || errno == ENOPROTOOPT )
+                {
+                    next_printf( NEXT_LOG_LEVEL_WARN, "udp segmentation offload failed (%s). disabling it for this socket", strerror( errno ) );
+                    socket->udp_segment = false;
+                }
+
+                const int first_packet = message_first_packet[num_sent];
+
+                next_platform_socket_send_packets_internal( socket, to + first_packet, packet_data + first_packet, packet_bytes + first_packet, num_packets - first_packet, false );
+
+                return;
+            }
+
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "sendmmsg failed: %s", strerror( errno ) );
+
+            num_sent++;
+        }
+        else
+        {
+            num_sent += result;
+        }
+    }
+}
+
+void next_platform_socket_send_packets( next_platform_socket_t * socket, const next_address_t * to, uint8_t ** packet_data, int * packet_bytes, int num_packets )
+{
+    next_assert( socket );
+
+    if ( socket->xdp && num_packets > 0 )
+    {
+        bool * sent = (bool*) alloca( sizeof(bool) * num_packets );
+
+        if ( next_platform_socket_send_xdp_packets( socket, to, packet_data, packet_bytes, num_packets, sent ) == num_packets )
+            return;
+
+        // whatever af_xdp couldn't send goes through the udp socket, in the original order
+
+        next_address_t * remaining_to = (next_address_t*) alloca( sizeof(next_address_t) * num_packets );
+        uint8_t ** remaining_packet_data = (uint8_t**) alloca( sizeof(uint8_t*) * num_packets );
+        int * remaining_packet_bytes = (int*) alloca( sizeof(int) * num_packets );
+        int num_remaining = 0;
+        for ( int i = 0; i < num_packets; ++i )
+        {
+            if ( sent[i] )
+                continue;
+            remaining_to[num_remaining] = to[i];
+            remaining_packet_data[num_remaining] = packet_data[i];
+            remaining_packet_bytes[num_remaining] = packet_bytes[i];
+            num_remaining++;
+        }
+
+        next_platform_socket_send_packets_internal( socket, remaining_to, remaining_packet_data, remaining_packet_bytes, num_remaining, socket->udp_segment );
+
+        return;
+    }
+
+    next_platform_socket_send_packets_internal( socket, to, packet_data, packet_bytes, num_packets, socket->udp_segment );
+}
+
+static bool next_platform_socket_read_address( const sockaddr_storage * sockaddr_from, next_address_t * from )
+{
+    if ( sockaddr_from->ss_family == AF_INET6 )
+    {
+        const sockaddr_in6 * addr_ipv6 = (const sockaddr_in6*) sockaddr_from;
+        from->type = NEXT_ADDRESS_IPV6;
+        for ( int i = 0; i < 8; ++i )
+        {
+            from->data.ipv6[i] = next_platform_ntohs( ( (const uint16_t*) &addr_ipv6->sin6_addr ) [i] );
+        }
+        from->port = next_platform_ntohs( addr_ipv6->sin6_port );
+        return true;
+    }
+    else if ( sockaddr_from->ss_family == AF_INET )
+    {
+        const sockaddr_in * addr_ipv4 = (const sockaddr_in*) sockaddr_from;
+        from->type = NEXT_ADDRESS_IPV4;
+        from->data.ipv4[0] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x000000FF ) );
+        from->data.ipv4[1] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x0000FF00 ) >> 8 );
+        from->data.ipv4[2] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x00FF0000 ) >> 16 );
+        from->data.ipv4[3] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0xFF000000 ) >> 24 );
+        from->port = next_platform_ntohs( addr_ipv4->sin_port );
+        return true;
+    }
+    return false;
+}
+
+static double next_platform_socket_read_timestamp( const msghdr * msg )
+{
+    // returns the kernel receive time in CLOCK_REALTIME seconds, or zero if the packet wasn't stamped
+
+    for ( cmsghdr * cmsg = CMSG_FIRSTHDR( msg ); cmsg != NULL; cmsg = CMSG_NXTHDR( (msghdr*) msg, cmsg ) )
+    {
+        if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+        {
+            timespec ts;
+            memcpy( &ts, CMSG_DATA( cmsg ), sizeof(ts) );
+            return double( ts.tv_sec ) + double( ts.tv_nsec ) / 1000000000.0;
+        }
+    }
+
+    return 0.0;
+}
+
+static int next_platform_socket_split_gro_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets )
+{
+    next_platform_socket_gro_t * gro = socket->gro;
+
+    next_assert( gro );
+
+    int num_packets = 0;
+
+    while ( num_packets < max_packets && gro->message_index < gro->num_messages )
+    {
+        const int index = gro->message_index;
+
+        int bytes = gro->message_bytes[index] - gro->message_offset;
+        if ( gro->segment_bytes[index] > 0 && gro->segment_bytes[index] < bytes )
+        {
+            bytes = gro->segment_bytes[index];
+        }
+
+        if ( bytes > 0 && bytes <= max_packet_size )
+        {
+            memcpy( packet_data[num_packets], gro->buffer[index] + gro->message_offset, bytes );
+            from[num_packets] = gro->from[index];
+            packet_bytes[num_packets] = bytes;
+            if ( receive_time )
+            {
+                receive_time[num_packets] = gro->receive_time[index];
+            }
+            num_packets++;
+        }
+
+        gro->message_offset += bytes;
+
+        if ( gro->message_offset >= gro->message_bytes[index] )
+        {
+            gro->message_index++;
+            gro->message_offset = 0;
+        }
+    }
+
+    return num_packets;
+}
+
+static int next_platform_socket_receive_gro_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets, bool block )
+{
+    next_platform_socket_gro_t * gro = socket->gro;
+
+    next_assert( gro );
+
+    // hand out packets left over from the previous coalesced receive before going back to the kernel
+
+    if ( gro->message_index < gro->num_messages )
+    {
+        return next_platform_socket_split_gro_packets( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets );
+    }
+
+    iovec msg[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    sockaddr_storage sockaddr_from[NEXT_PLATFORM_GRO_BATCH_SIZE];
+    mmsghdr packet_array[NEXT_PLATFORM_GRO_BATCH_SIZE];
+
+    memset( packet_array, 0, sizeof(packet_array) );
+
+    for ( int i = 0; i < NEXT_PLATFORM_GRO_BATCH_SIZE; ++i )
+    {
+        msg[i].iov_base = gro->buffer[i];
+        msg[i].iov_len = NEXT_PLATFORM_GRO_BUFFER_BYTES;
+        packet_array[i].msg_hdr.msg_name = &sockaddr_from[i];
+        packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        packet_array[i].msg_hdr.msg_iov = &msg[i];
+        packet_array[i].msg_hdr.msg_iovlen = 1;
+        packet_array[i].msg_hdr.msg_control = gro->control[i];
+        packet_array[i].msg_hdr.msg_controllen = NEXT_PLATFORM_GRO_CONTROL_BYTES;
+    }
+
+    const int flags = block ? MSG_WAITFORONE : MSG_DONTWAIT;
+
+    int result = recvmmsg( socket->handle, packet_array, NEXT_PLATFORM_GRO_BATCH_SIZE, flags, NULL );
+
+    if ( result <= 0 )
+    {
+        if ( result < 0 && errno != EAGAIN && errno != EINTR )
+        {
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "recvmmsg failed with error %d", errno );
+        }
+
+        return 0;
+    }
+
+    for ( int i = 0; i < result; ++i )
+    {
+        gro->message_bytes[i] = int( packet_array[i].msg_len );
+        gro->segment_bytes[i] = 0;
+        gro->receive_time[i] = 0.0;
+
+        if ( !next_platform_socket_read_address( &sockaddr_from[i], &gro->from[i] ) || ( packet_array[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+        {
+            gro->message_bytes[i] = 0;
+            continue;
+        }
+
+        for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &packet_array[i].msg_hdr ); cmsg != NULL; cmsg = CMSG_NXTHDR( &packet_array[i].msg_hdr, cmsg ) )
+        {
+            if ( cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO )
+            {
+                int segment_bytes = 0;
+                memcpy( &segment_bytes, CMSG_DATA( cmsg ), sizeof(int) );
+                gro->segment_bytes[i] = segment_bytes;
+            }
+        }
+
+        // every segment of a coalesced message shares its timestamp
+
+        gro->receive_time[i] = next_platform_socket_read_timestamp( &packet_array[i].msg_hdr );
+    }
+
+    gro->num_messages = result;
+    gro->message_index = 0;
+    gro->message_offset = 0;
+
+    return next_platform_socket_split_gro_packets( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets );
+}
+
+// IMPORTANT: The io_uring backend only replaces the receive side of the socket. Each buffer in the provided buffer ring holds
+// the io_uring_recvmsg_out header, the source address and then the payload, so it must fit sizeof(io_uring_recvmsg_out) +
+// sizeof(sockaddr_storage) + NEXT_MAX_PACKET_BYTES. Sends stay on sendmmsg, because the game thread and the internal thread
+// both send on the same socket and sendmmsg is already one syscall per batch, without needing a lock around a shared SQ.
+
+struct next_platform_socket_uring_t
+{
+    int ring_fd;
+    uint8_t * sq_ring;
+    size_t sq_ring_bytes;
+    uint8_t * cq_ring;
+    size_t cq_ring_bytes;
+    uint8_t * sqe_memory;
+    size_t sqe_memory_bytes;
+    uint32_t * sq_head;
+    uint32_t * sq_tail;
+    uint32_t * sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t * cq_head;
+    uint32_t * cq_tail;
+    uint32_t cq_mask;
+#if NEXT_PLATFORM_HAS_IO_URING
+    io_uring_sqe * sqes;
+    io_uring_cqe * cqes;
+    io_uring_buf_ring * buffer_ring;
+#endif // #if NEXT_PLATFORM_HAS_IO_URING
+    size_t buffer_ring_bytes;
+    uint8_t * buffers;
+    size_t buffers_bytes;
+    uint16_t buffer_tail;
+    msghdr receive_msg;
+    bool receive_armed;
+    bool failed;
+    bool has_timeout;
+    int64_t timeout_seconds;
+    int64_t timeout_nanoseconds;
+};
+
+#if NEXT_PLATFORM_HAS_IO_URING
+
+static int next_platform_io_uring_setup( unsigned int entries, io_uring_params * params )
+{
+    return (int) syscall( __NR_io_uring_setup, entries, params );
+}
+
+static int next_platform_io_uring_enter( int ring_fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, const void * arg, size_t arg_bytes )
+{
+    return (int) syscall( __NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_bytes );
+}
+
+static int next_platform_io_uring_register( int ring_fd, unsigned int opcode, void * arg, unsigned int num_args )
+{
+    return (int) syscall( __NR_io_uring_register, ring_fd, opcode, arg, num_args );
+}
+
+static void next_platform_socket_free_io_uring( void * context, next_platform_socket_uring_t * uring )
+{
+    if ( uring->buffers )
+    {
+        munmap( uring->buffers, uring->buffers_bytes );
+    }
+    if ( uring->buffer_ring )
+    {
+        munmap( uring->buffer_ring, uring->buffer_ring_bytes );
+    }
+    if ( uring->sqe_memory )
+    {
+        munmap( uring->sqe_memory, uring->sqe_memory_bytes );
+    }
+    if ( uring->cq_ring && uring->cq_ring != uring->sq_ring )
+    {
+        munmap( uring->cq_ring, uring->cq_ring_bytes );
+    }
+    if ( uring->sq_ring )
+    {
+        munmap( uring->sq_ring, uring->sq_ring_bytes );
+    }
+    if ( uring->ring_fd >= 0 )
+    {
+        close( uring->ring_fd );
+    }
+    next_free( context, uring );
+}
+
+static uint8_t * next_platform_io_uring_map( int fd, size_t bytes, off_t offset )
+{
+    void * p = mmap( NULL, bytes, PROT_READ | PROT_WRITE, ( fd >= 0 ) ? ( MAP_SHARED | MAP_POPULATE ) : ( MAP_PRIVATE | MAP_ANONYMOUS ), fd, offset );
+    return ( p != MAP_FAILED ) ? (uint8_t*) p : NULL;
+}
+
+static void next_platform_socket_recycle_io_uring_buffer( next_platform_socket_uring_t * uring, int buffer_id )
+{
+    // IMPORTANT: Don't index through io_uring_buf_ring::bufs. In C++ the empty struct in __DECLARE_FLEX_ARRAY has a size,
+    // which moves bufs to offset 8 and out of line with the kernel. The ring is a plain array of io_uring_buf with the tail
+    // laid over the resv field of the first entry.
+
+    io_uring_buf * buffer = ( (io_uring_buf*) uring->buffer_ring ) + ( uring->buffer_tail & ( NEXT_PLATFORM_IO_URING_NUM_BUFFERS - 1 ) );
+    buffer->addr = (uint64_t) (uintptr_t) ( uring->buffers + size_t( buffer_id ) * NEXT_PLATFORM_IO_URING_BUFFER_BYTES );
+    buffer->len = NEXT_PLATFORM_IO_URING_BUFFER_BYTES;
+    buffer->bid = uint16_t( buffer_id );
+    uring->buffer_tail++;
+    __atomic_store_n( &uring->buffer_ring->tail, uring->buffer_tail, __ATOMIC_RELEASE );
+}
+
+static bool next_platform_socket_push_io_uring_sqe( next_platform_socket_uring_t * uring, const io_uring_sqe * sqe )
+{
+    const uint32_t tail = *uring->sq_tail;
+    const uint32_t head = __atomic_load_n( uring->sq_head, __ATOMIC_ACQUIRE );
+    if ( tail - head >= uring->sq_entries )
+        return false;
+    const uint32_t index = tail & uring->sq_mask;
+    uring->sqes[index] = *sqe;
+    uring->sq_array[index] = index;
+    __atomic_store_n( uring->sq_tail, tail + 1, __ATOMIC_RELEASE );
+    return true;
+}
+
+static unsigned int next_platform_socket_io_uring_pending( next_platform_socket_uring_t * uring )
+{
+    return *uring->sq_tail - __atomic_load_n( uring->sq_head, __ATOMIC_ACQUIRE );
+}
+
+static void next_platform_socket_arm_io_uring( next_platform_socket_t * socket )
+{
+    next_platform_socket_uring_t * uring = socket->uring;
+
+    // IMPORTANT: The multishot receive must be submitted from the thread that receives. Its completions run as task work
+    // on the submitting thread, so arming it from the thread that created the socket would delay every packet.
+
+    io_uring_sqe sqe;
+    memset( &sqe, 0, sizeof(sqe) );
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = socket->handle;
+    sqe.addr = (uint64_t) (uintptr_t) &uring->receive_msg;
+    sqe.len = 1;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = NEXT_PLATFORM_IO_URING_BUFFER_GROUP;
+    sqe.user_data = NEXT_PLATFORM_IO_URING_RECEIVE_USER_DATA;
+
+    if ( next_platform_socket_push_io_uring_sqe( uring, &sqe ) )
+    {
+        uring->receive_armed = true;
+    }
+}
+
+static int next_platform_socket_reap_io_uring( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets, bool * cancelled )
+{
+    next_platform_socket_uring_t * uring = socket->uring;
+
+    int num_packets = 0;
+
+    uint32_t head = *uring->cq_head;
+
+    while ( num_packets < max_packets )
+    {
+        const uint32_t tail = __atomic_load_n( uring->cq_tail, __ATOMIC_ACQUIRE );
+        if ( head == tail )
+            break;
+
+        const io_uring_cqe * cqe = &uring->cqes[head & uring->cq_mask];
+
+        head++;
+
+        if ( cqe->user_data == NEXT_PLATFORM_IO_URING_CANCEL_USER_DATA )
+        {
+            if ( cancelled )
+            {
+                *cancelled = true;
+            }
+            continue;
+        }
+
+        if ( cqe->user_data != NEXT_PLATFORM_IO_URING_RECEIVE_USER_DATA )
+            continue;
+
+        if ( ( cqe->flags & IORING_CQE_F_MORE ) == 0 )
+        {
+            // the multishot receive has stopped. running out of buffers or being cancelled just means we arm it again.
+            // anything else means the kernel can't do multishot receives on this socket, so we fall back to recvmmsg
+
+            uring->receive_armed = false;
+
+            if ( cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED && cqe->res != -EINTR )
+            {
+                next_printf( NEXT_LOG_LEVEL_WARN, "io_uring receive failed: %s", strerror( -cqe->res ) );
+                uring->failed = true;
+            }
+        }
+
+        if ( ( cqe->flags & IORING_CQE_F_BUFFER ) == 0 )
+            continue;
+
+        const int buffer_id = int( cqe->flags >> IORING_CQE_BUFFER_SHIFT );
+
+        next_assert( buffer_id < NEXT_PLATFORM_IO_URING_NUM_BUFFERS );
+
+        if ( cqe->res >= int( sizeof(io_uring_recvmsg_out) ) && from && packet_data )
+        {
+            const uint8_t * buffer = uring->buffers + size_t( buffer_id ) * NEXT_PLATFORM_IO_URING_BUFFER_BYTES;
+
+            io_uring_recvmsg_out out;
+            memcpy( &out, buffer, sizeof(out) );
+
+            sockaddr_storage sockaddr_from;
+            memset( &sockaddr_from, 0, sizeof(sockaddr_from) );
+            memcpy( &sockaddr_from, buffer + sizeof(io_uring_recvmsg_out), ( out.namelen < sizeof(sockaddr_from) ) ? out.namelen : sizeof(sockaddr_from) );
+
+            const uint8_t * payload = buffer + sizeof(io_uring_recvmsg_out) + uring->receive_msg.msg_namelen + uring->receive_msg.msg_controllen;
+
+            if ( ( out.flags & MSG_TRUNC ) == 0 && int( out.payloadlen ) <= max_packet_size && next_platform_socket_read_address( &sockaddr_from, &from[num_packets] ) )
+            {
+                memcpy( packet_data[num_packets], payload, out.payloadlen );
+                packet_bytes[num_packets] = int( out.payloadlen );
+                if ( receive_time )
+                {
+                    msghdr control;
+                    memset( &control, 0, sizeof(control) );
+                    control.msg_control = (void*) ( buffer + sizeof(io_uring_recvmsg_out) + uring->receive_msg.msg_namelen );
+                    control.msg_controllen = ( out.controllen < uring->receive_msg.msg_controllen ) ? out.controllen : uring->receive_msg.msg_controllen;
+                    receive_time[num_packets] = next_platform_socket_read_timestamp( &control );
+                }
+                num_packets++;
+            }
+        }
+
+        next_platform_socket_recycle_io_uring_buffer( uring, buffer_id );
+    }
+
+    __atomic_store_n( uring->cq_head, head, __ATOMIC_RELEASE );
+
+    return num_packets;
+}
+
+#endif // #if NEXT_PLATFORM_HAS_IO_URING
+
+int next_platform_socket_enable_io_uring( next_platform_socket_t * socket )
+{
+    next_assert( socket );
+
+#if NEXT_PLATFORM_HAS_IO_URING
+
+    if ( socket->uring )
+        return NEXT_OK;
+
+    next_platform_socket_uring_t * uring = (next_platform_socket_uring_t*) next_malloc( socket->context, sizeof( next_platform_socket_uring_t ) );
+    if ( !uring )
+        return NEXT_ERROR;
+
+    memset( uring, 0, sizeof( next_platform_socket_uring_t ) );
+
+    io_uring_params params;
+    memset( &params, 0, sizeof(params) );
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = NEXT_PLATFORM_IO_URING_NUM_BUFFERS * 2;
+
+    uring->ring_fd = next_platform_io_uring_setup( NEXT_PLATFORM_IO_URING_QUEUE_DEPTH, &params );
+    if ( uring->ring_fd < 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "io_uring is not available: %s", strerror( errno ) );
+        next_platform_socket_free_io_uring( socket->context, uring );
+        return NEXT_ERROR;
+    }
+
+    if ( ( params.features & IORING_FEAT_EXT_ARG ) == 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "io_uring does not support receive timeouts on this kernel" );
+        next_platform_socket_free_io_uring( socket->context, uring );
+        return NEXT_ERROR;
+    }
+
+    uring->sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    uring->cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        if ( uring->cq_ring_bytes > uring->sq_ring_bytes )
+        {
+            uring->sq_ring_bytes = uring->cq_ring_bytes;
+        }
+        uring->cq_ring_bytes = uring->sq_ring_bytes;
+    }
+
+    uring->sq_ring = next_platform_io_uring_map( uring->ring_fd, uring->sq_ring_bytes, IORING_OFF_SQ_RING );
+    uring->cq_ring = ( params.features & IORING_FEAT_SINGLE_MMAP ) ? uring->sq_ring : next_platform_io_uring_map( uring->ring_fd, uring->cq_ring_bytes, IORING_OFF_CQ_RING );
+    uring->sqe_memory_bytes = params.sq_entries * sizeof(io_uring_sqe);
+    uring->sqe_memory = next_platform_io_uring_map( uring->ring_fd, uring->sqe_memory_bytes, IORING_OFF_SQES );
+
+    // IMPORTANT: The buffers are mapped rather than allocated, so a late write from the kernel can never land in memory that
+    // has been handed back to the allocator and reused for something else
+
+    uring->buffer_ring_bytes = NEXT_PLATFORM_IO_URING_NUM_BUFFERS * sizeof(io_uring_buf);
+    uring->buffer_ring = (io_uring_buf_ring*) next_platform_io_uring_map( -1, uring->buffer_ring_bytes, 0 );
+    uring->buffers_bytes = size_t( NEXT_PLATFORM_IO_URING_NUM_BUFFERS ) * NEXT_PLATFORM_IO_URING_BUFFER_BYTES;
+    uring->buffers = next_platform_io_uring_map( -1, uring->buffers_bytes, 0 );
+
+    if ( !uring->sq_ring || !uring->cq_ring || !uring->sqe_memory || !uring->buffer_ring || !uring->buffers )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "could not map io_uring memory" );
+        next_platform_socket_free_io_uring( socket->context, uring );
+        return NEXT_ERROR;
+    }
+
+    uring->sq_head = (uint32_t*) ( uring->sq_ring + params.sq_off.head );
+    uring->sq_tail = (uint32_t*) ( uring->sq_ring + params.sq_off.tail );
+    uring->sq_array = (uint32_t*) ( uring->sq_ring + params.sq_off.array );
+    uring->sq_mask = *(uint32_t*) ( uring->sq_ring + params.sq_off.ring_mask );
+    uring->sq_entries = params.sq_entries;
+    uring->sqes = (io_uring_sqe*) uring->sqe_memory;
+    uring->cq_head = (uint32_t*) ( uring->cq_ring + params.cq_off.head );
+    uring->cq_tail = (uint32_t*) ( uring->cq_ring + params.cq_off.tail );
+    uring->cq_mask = *(uint32_t*) ( uring->cq_ring + params.cq_off.ring_mask );
+    uring->cqes = (io_uring_cqe*) ( uring->cq_ring + params.cq_off.cqes );
+
+    io_uring_buf_reg buffer_reg;
+    memset( &buffer_reg, 0, sizeof(buffer_reg) );
+    buffer_reg.ring_addr = (uint64_t) (uintptr_t) uring->buffer_ring;
+    buffer_reg.ring_entries = NEXT_PLATFORM_IO_URING_NUM_BUFFERS;
+    buffer_reg.bgid = NEXT_PLATFORM_IO_URING_BUFFER_GROUP;
+
+    if ( next_platform_io_uring_register( uring->ring_fd, IORING_REGISTER_PBUF_RING, &buffer_reg, 1 ) < 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "io_uring provided buffer rings are not supported: %s", strerror( errno ) );
+        next_platform_socket_free_io_uring( socket->context, uring );
+        return NEXT_ERROR;
+    }
+
+    for ( int i = 0; i < NEXT_PLATFORM_IO_URING_NUM_BUFFERS; ++i )
+    {
+        next_platform_socket_recycle_io_uring_buffer( uring, i );
+    }
+
+    uring->receive_msg.msg_namelen = sizeof(sockaddr_storage);
+    uring->receive_msg.msg_controllen = NEXT_PLATFORM_TIMESTAMP_CONTROL_BYTES;
+
+    // blocking sockets keep their receive timeout, so the internal threads still wake up to check for quit
+
+    struct timeval tv;
+    memset( &tv, 0, sizeof(tv) );
+    socklen_t tv_length = sizeof(tv);
+    if ( getsockopt( socket->handle, SOL_SOCKET, SO_RCVTIMEO, &tv, &tv_length ) == 0 && ( tv.tv_sec > 0 || tv.tv_usec > 0 ) )
+    {
+        uring->has_timeout = true;
+        uring->timeout_seconds = tv.tv_sec;
+        uring->timeout_nanoseconds = int64_t( tv.tv_usec ) * 1000;
+    }
+
+    // udp receive offload hands us coalesced datagrams much larger than our buffers, so it can't be combined with io_uring
+
+    if ( socket->gro )
+    {
+        int no = 0;
+        setsockopt( socket->handle, IPPROTO_UDP, UDP_GRO, (char*)( &no ), sizeof( int ) );
+        next_free( socket->context, socket->gro );
+        socket->gro = NULL;
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "disabled udp receive offload in favor of io_uring" );
+    }
+
+    socket->uring = uring;
+
+    next_printf( NEXT_LOG_LEVEL_DEBUG, "enabled io_uring receive" );
+
+    return NEXT_OK;
+
+#else // #if NEXT_PLATFORM_HAS_IO_URING
+
+    next_printf( NEXT_LOG_LEVEL_WARN, "io_uring is not supported by this build" );
+
+    return NEXT_ERROR;
+
+#endif // #if NEXT_PLATFORM_HAS_IO_URING
+}
+
+static void next_platform_socket_destroy_io_uring( next_platform_socket_t * socket )
+{
+#if NEXT_PLATFORM_HAS_IO_URING
+
+    next_platform_socket_uring_t * uring = socket->uring;
+    if ( !uring )
+        return;
+
+    // IMPORTANT: Cancel the multishot receive and wait for it to finish before unmapping its buffers.
+    // If the receiving thread has already exited, the kernel cancelled it then, and the cancel just comes back empty.
+
+    if ( uring->receive_armed )
+    {
+        io_uring_sqe sqe;
+        memset( &sqe, 0, sizeof(sqe) );
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = NEXT_PLATFORM_IO_URING_RECEIVE_USER_DATA;
+        sqe.user_data = NEXT_PLATFORM_IO_URING_CANCEL_USER_DATA;
+
+        if ( next_platform_socket_push_io_uring_sqe( uring, &sqe ) )
+        {
+            __kernel_timespec ts;
+            ts.tv_sec = 0;
+            ts.tv_nsec = 10 * 1000 * 1000;
+
+            io_uring_getevents_arg arg;
+            memset( &arg, 0, sizeof(arg) );
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+
+            bool cancelled = false;
+
+            for ( int i = 0; i < 100 && uring->receive_armed && !cancelled; ++i )
+            {
+                next_platform_io_uring_enter( uring->ring_fd, next_platform_socket_io_uring_pending( uring ), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg) );
+                next_platform_socket_reap_io_uring( socket, NULL, NULL, NULL, NULL, 0, NEXT_PLATFORM_IO_URING_NUM_BUFFERS * 2, &cancelled );
+            }
+        }
+    }
+
+    next_platform_socket_free_io_uring( socket->context, uring );
+
+    socket->uring = NULL;
+
+#else // #if NEXT_PLATFORM_HAS_IO_URING
+
+    (void) socket;
+
+#endif // #if NEXT_PLATFORM_HAS_IO_URING
+}
+
+static int next_platform_socket_receive_io_uring_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets, bool block )
+{
+#if NEXT_PLATFORM_HAS_IO_URING
+
+    next_platform_socket_uring_t * uring = socket->uring;
+
+    next_assert( uring );
+
+    // completions that are already sitting in the ring cost no syscall at all
+
+    int num_packets = next_platform_socket_reap_io_uring( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, NULL );
+
+    if ( num_packets == 0 && !uring->failed )
+    {
+        if ( !uring->receive_armed )
+        {
+            next_platform_socket_arm_io_uring( socket );
+        }
+
+        // one syscall submits any pending arm and waits for the next completion, up to the socket receive timeout
+
+        const bool blocking = block;
+
+        __kernel_timespec ts;
+        ts.tv_sec = uring->timeout_seconds;
+        ts.tv_nsec = uring->timeout_nanoseconds;
+
+        io_uring_getevents_arg arg;
+        memset( &arg, 0, sizeof(arg) );
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+
+        const bool use_timeout = blocking && uring->has_timeout;
+
+        const int result = next_platform_io_uring_enter( uring->ring_fd, next_platform_socket_io_uring_pending( uring ), blocking ? 1 : 0, IORING_ENTER_GETEVENTS | ( use_timeout ? IORING_ENTER_EXT_ARG : 0 ), use_timeout ? &arg : NULL, use_timeout ? sizeof(arg) : 0 );
+
+        if ( result < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY )
+        {
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "io_uring_enter failed with error %d", errno );
+        }
+
+        num_packets = next_platform_socket_reap_io_uring( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, NULL );
+    }
+
+    if ( uring->failed )
+    {
+        next_printf( NEXT_LOG_LEVEL_WARN, "falling back to recvmmsg for this socket" );
+        next_platform_socket_destroy_io_uring( socket );
+    }
+
+    return num_packets;
+
+#else // #if NEXT_PLATFORM_HAS_IO_URING
+
+    (void) socket;
+    (void) from;
+    (void) packet_data;
+    (void) packet_bytes;
+    (void) receive_time;
+    (void) max_packet_size;
+    (void) max_packets;
+    (void) block;
+
+    return 0;
+
+#endif // #if NEXT_PLATFORM_HAS_IO_URING
+}
+
+int next_platform_socket_receive_packet( next_platform_socket_t * socket, next_address_t * from, void * packet_data, int max_packet_size )
+{
+    next_assert( socket );
+    next_assert( from );
+    next_assert( packet_data );
+    next_assert( max_packet_size > 0 );
+
+    if ( socket->uring || socket->xdp || socket->busy_poll_microseconds > 0 )
+    {
+        uint8_t * packet_buffer = (uint8_t*) packet_data;
+        int packet_bytes = 0;
+        return next_platform_socket_receive_packets( socket, from, &packet_buffer, &packet_bytes, NULL, max_packet_size, 1 ) ? packet_bytes : 0;
+    }
+
+    if ( socket->gro )
+    {
+        uint8_t * packet_buffer = (uint8_t*) packet_data;
+        int packet_bytes = 0;
+        return next_platform_socket_receive_gro_packets( socket, from, &packet_buffer, &packet_bytes, NULL, max_packet_size, 1, socket->type == NEXT_PLATFORM_SOCKET_BLOCKING ) ? packet_bytes : 0;
+    }
+
+    sockaddr_storage sockaddr_from;
+    socklen_t from_length = sizeof( sockaddr_from );
+
+    int result = int( recvfrom( socket->handle, (char*) packet_data, max_packet_size, socket->type == NEXT_PLATFORM_SOCKET_NON_BLOCKING ? MSG_DONTWAIT : 0, (sockaddr*) &sockaddr_from, &from_length ) );
+
+    if ( result <= 0 )
+    {
+        if ( errno == EAGAIN || errno == EINTR )
+        {
+            return 0;
+        }
+
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "recvfrom failed with error %d", errno );
+        
+        return 0;
+    }
+
+    if ( !next_platform_socket_read_address( &sockaddr_from, from ) )
+    {
+        next_assert( 0 );
+        return 0;
+    }
+  
+    next_assert( result >= 0 );
+
+    return result;
+}
+
+static int next_platform_socket_receive_mmsg_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets, int flags )
+{
+    iovec * msg = (iovec*) alloca( sizeof(iovec) * max_packets );
+
+    const bool timestamps = receive_time && socket->receive_timestamps;
+
+    uint8_t * control = timestamps ? (uint8_t*) alloca( NEXT_PLATFORM_TIMESTAMP_CONTROL_BYTES * max_packets ) : NULL;
+
+    sockaddr_storage * sockaddr_from = (sockaddr_storage*) alloca( sizeof(sockaddr_storage) * max_packets );
+
+    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * max_packets );
+
+    memset( packet_array, 0, sizeof(mmsghdr) * max_packets );
+
+    for ( int i = 0; i < max_packets; ++i )
+    {
+        msg[i].iov_base = packet_data[i];
+        msg[i].iov_len = max_packet_size;
+        packet_array[i].msg_hdr.msg_name = &sockaddr_from[i];
+        packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        packet_array[i].msg_hdr.msg_iov = &msg[i];
+        packet_array[i].msg_hdr.msg_iovlen = 1;
+        if ( timestamps )
+        {
+            packet_array[i].msg_hdr.msg_control = control + i * NEXT_PLATFORM_TIMESTAMP_CONTROL_BYTES;
+            packet_array[i].msg_hdr.msg_controllen = NEXT_PLATFORM_TIMESTAMP_CONTROL_BYTES;
+        }
+    }
+
+    int result = recvmmsg( socket->handle, packet_array, max_packets, flags, NULL );
+
+    if ( result <= 0 )
+    {
+        if ( result < 0 && errno != EAGAIN && errno != EINTR )
+        {
+            next_printf( NEXT_LOG_LEVEL_DEBUG, "recvmmsg failed with error %d", errno );
+        }
+
+        return 0;
+    }
+
+    int num_packets = 0;
+
+    for ( int i = 0; i < result; ++i )
+    {
+        if ( !next_platform_socket_read_address( &sockaddr_from[i], &from[num_packets] ) )
+            continue;
+
+        if ( packet_array[i].msg_hdr.msg_flags & MSG_TRUNC )
+            continue;
+
+        // IMPORTANT: Keep the buffer for each packet paired with its address when we skip one
+        if ( num_packets != i )
+        {
+            uint8_t * temp = packet_data[num_packets];
+            packet_data[num_packets] = packet_data[i];
+            packet_data[i] = temp;
+        }
+
+        packet_bytes[num_packets] = int( packet_array[i].msg_len );
+
+        if ( receive_time )
+        {
+            receive_time[num_packets] = timestamps ? next_platform_socket_read_timestamp( &packet_array[i].msg_hdr ) : 0.0;
+        }
+
+        num_packets++;
+    }
+
+    return num_packets;
+}
+
+static int next_platform_socket_receive_packets_internal( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets, bool block )
+{
+    if ( socket->xdp )
+    {
+        // drain af_xdp first, then top up from the udp socket. only block when neither has anything
+
+        for ( int attempt = 0; attempt < 2; ++attempt )
+        {
+            int num_packets = next_platform_socket_receive_xdp_packets( socket, from, packet_data, packet_bytes, max_packet_size, max_packets );
+
+            // af_xdp frames carry no kernel timestamp, so they fall back to the time we picked them up
+
+            if ( receive_time )
+            {
+                for ( int i = 0; i < num_packets; ++i )
+                {
+                    receive_time[i] = 0.0;
+                }
+            }
+
+            if ( num_packets < max_packets )
+            {
+                num_packets += next_platform_socket_receive_mmsg_packets( socket, from + num_packets, packet_data + num_packets, packet_bytes + num_packets, receive_time ? receive_time + num_packets : NULL, max_packet_size, max_packets - num_packets, MSG_DONTWAIT );
+            }
+
+            if ( num_packets > 0 || attempt > 0 || !block )
+                return num_packets;
+
+            pollfd fds[2];
+            fds[0].fd = socket->xdp->xsk_fd;
+            fds[0].events = POLLIN;
+            fds[0].revents = 0;
+            fds[1].fd = socket->handle;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            poll( fds, 2, socket->xdp->timeout_milliseconds );
+        }
+
+        return 0;
+    }
+
+    if ( socket->uring )
+    {
+        return next_platform_socket_receive_io_uring_packets( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, block );
+    }
+
+    if ( socket->gro )
+    {
+        return next_platform_socket_receive_gro_packets( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, block );
+    }
+
+    // IMPORTANT: For blocking sockets, MSG_WAITFORONE blocks (up to the socket receive timeout) until the first packet 
+    // arrives, then drains whatever else is already queued without blocking again. One syscall per wakeup, not per packet.
+
+    const int flags = block ? MSG_WAITFORONE : MSG_DONTWAIT;
+
+    return next_platform_socket_receive_mmsg_packets( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, flags );
+}
+
+static void next_platform_socket_sample_wakeup_latency( double packet_time, uint64_t * samples, uint64_t * total_microseconds, uint64_t * max_microseconds )
+{
+    // the kernel stamps each packet as it arrives. the time from that stamp to now is how long the packet waited for us
+
+    if ( packet_time <= 0.0 )
+        return;
+
+    struct timespec current_time;
+    clock_gettime( CLOCK_REALTIME, &current_time );
+
+    const double seconds = ( double( current_time.tv_sec ) + double( current_time.tv_nsec ) / 1000000000.0 ) - packet_time;
+    if ( seconds < 0.0 || seconds >= NEXT_PLATFORM_MAX_TIMESTAMP_AGE )
+        return;
+
+    const uint64_t microseconds = uint64_t( seconds * 1000000.0 );
+
+    *samples += 1;
+    *total_microseconds += microseconds;
+    if ( max_microseconds && microseconds > *max_microseconds )
+    {
+        *max_microseconds = microseconds;
+    }
+}
+
+static int next_platform_socket_receive_packets_wait( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * receive_time, int max_packet_size, int max_packets )
+{
+    const bool block = socket->type == NEXT_PLATFORM_SOCKET_BLOCKING;
+
+    if ( !block || socket->busy_poll_microseconds <= 0 )
+    {
+        return next_platform_socket_receive_packets_internal( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, block );
+    }
+
+    // busy poll: spin on non-blocking receives for up to the budget, and only then pay for a sleep and wakeup in a blocking receive
+
+    next_platform_socket_busy_poll_stats_t * stats = &socket->busy_poll_stats;
+
+    if ( !receive_time )
+    {
+        receive_time = (double*) alloca( sizeof(double) * max_packets );
+    }
+
+    const double spin_end_time = next_platform_time() + socket->busy_poll_microseconds * 0.000001;
+
+    do
+    {
+        const int num_packets = next_platform_socket_receive_packets_internal( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, false );
+        if ( num_packets > 0 )
+        {
+            stats->spin_receives++;
+            if ( ( stats->spin_receives % NEXT_PLATFORM_BUSY_POLL_SPIN_SAMPLE_RATE ) == 0 )
+            {
+                next_platform_socket_sample_wakeup_latency( receive_time[0], &stats->spin_latency_samples, &stats->spin_latency_total_microseconds, NULL );
+            }
+            return num_packets;
+        }
+    }
+    while ( next_platform_time() < spin_end_time );
+
+    const int num_packets = next_platform_socket_receive_packets_internal( socket, from, packet_data, packet_bytes, receive_time, max_packet_size, max_packets, true );
+    if ( num_packets > 0 )
+    {
+        stats->blocking_receives++;
+        next_platform_socket_sample_wakeup_latency( receive_time[0], &stats->wakeup_latency_samples, &stats->wakeup_latency_total_microseconds, &stats->wakeup_latency_max_microseconds );
+    }
+
+    return num_packets;
+}
+
+int next_platform_socket_receive_packets( next_platform_socket_t * socket, next_address_t * from, uint8_t ** packet_data, int * packet_bytes, double * packet_receive_time, int max_packet_size, int max_packets )
+{
+    next_assert( socket );
+    next_assert( from );
+    next_assert( packet_data );
+    next_assert( packet_bytes );
+    next_assert( max_packet_size > 0 );
+    next_assert( max_packets > 0 );
+
+    const int num_packets = next_platform_socket_receive_packets_wait( socket, from, packet_data, packet_bytes, packet_receive_time, max_packet_size, max_packets );
+
+    if ( packet_receive_time && num_packets > 0 )
+    {
+        // kernel timestamps are CLOCK_REALTIME. convert each one to how long ago the packet arrived, then onto next_platform_time.
+        // packets without a timestamp, or with one that doesn't make sense because the wall clock stepped, fall back to now
+
+        timespec ts;
+        clock_gettime( CLOCK_REALTIME, &ts );
+        const double current_realtime = double( ts.tv_sec ) + double( ts.tv_nsec ) / 1000000000.0;
+        const double current_time = next_platform_time();
+
+        for ( int i = 0; i < num_packets; ++i )
+        {
+            const double age = current_realtime - packet_receive_time[i];
+            packet_receive_time[i] = ( packet_receive_time[i] > 0.0 && age >= 0.0 && age < NEXT_PLATFORM_MAX_TIMESTAMP_AGE ) ? current_time - age : current_time;
+        }
+    }
+
+    return num_packets;
+}
+
+int next_platform_socket_enable_busy_poll( next_platform_socket_t * socket, int microseconds )
+{
+    next_assert( socket );
+    next_assert( microseconds > 0 );
+
+    socket->busy_poll_microseconds = microseconds;
+
+    // ask the kernel to busy poll the device queue too. raising SO_BUSY_POLL above net.core.busy_read and setting the budget need
+    // CAP_NET_ADMIN, so these can fail. the spin in userspace works either way
+
+    if ( setsockopt( socket->handle, SOL_SOCKET, SO_BUSY_POLL, (char*)( &microseconds ), sizeof( int ) ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "could not set SO_BUSY_POLL: %s", strerror( errno ) );
+    }
+
+    int yes = 1;
+    if ( setsockopt( socket->handle, SOL_SOCKET, SO_PREFER_BUSY_POLL, (char*)( &yes ), sizeof( int ) ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "could not set SO_PREFER_BUSY_POLL: %s", strerror( errno ) );
+    }
+
+    int budget = NEXT_PLATFORM_BUSY_POLL_BUDGET;
+    if ( setsockopt( socket->handle, SOL_SOCKET, SO_BUSY_POLL_BUDGET, (char*)( &budget ), sizeof( int ) ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_DEBUG, "could not set SO_BUSY_POLL_BUDGET: %s", strerror( errno ) );
+    }
+
+    return NEXT_OK;
+}
+
+void next_platform_socket_get_busy_poll_stats( next_platform_socket_t * socket, next_platform_socket_busy_poll_stats_t * stats )
+{
+    next_assert( socket );
+    next_assert( stats );
+    *stats = socket->busy_poll_stats;
+}
+
+// ---------------------------------------------------
+
+next_platform_thread_t * next_platform_thread_create( void * context, next_platform_thread_func_t * thread_function, void * arg )
+{
+    next_platform_thread_t * thread = (next_platform_thread_t*) next_malloc( context, sizeof( next_platform_thread_t) );
+
+    next_assert( thread );
+
+    thread->context = context;
+    
+    if ( pthread_create( &thread->handle, NULL, thread_function, arg ) != 0 )
+    {
+        next_free( context, thread );
+        return NULL;
+    }
+
+    return thread;
+}
+
+void next_platform_thread_join( next_platform_thread_t * thread )
+{
+    next_assert( thread );
+    pthread_join( thread->handle, NULL );
+}
+
+void next_platform_thread_destroy( next_platform_thread_t * thread )
+{
+    next_assert( thread );
+    next_free( thread->context, thread );
+}
+
+bool next_platform_thread_high_priority( next_platform_thread_t * thread )
+{
+    struct sched_param param;
+    param.sched_priority = sched_get_priority_max( SCHED_FIFO );
+    return pthread_setschedparam( thread->handle, SCHED_FIFO, &param ) == 0;
+}
+
+// ---------------------------------------------------
+
+int next_platform_mutex_create( next_platform_mutex_t * mutex )
+{
+    next_assert( mutex );
+
+    memset( mutex, 0, sizeof(next_platform_mutex_t) );
+    
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_settype( &attr, 0 );
+    int result = pthread_mutex_init( &mutex->handle, &attr );
+    pthread_mutexattr_destroy( &attr );
+
+    if ( result != 0 )
+        return NEXT_ERROR;
+
+    mutex->ok = true;
+
+    return NEXT_OK;
+}
+
+void next_platform_mutex_acquire( next_platform_mutex_t * mutex )
+{
+    next_assert( mutex );
+    next_assert( mutex->ok );
+    pthread_mutex_lock( &mutex->handle );
+}
+
+void next_platform_mutex_release( next_platform_mutex_t * mutex )
+{
+    next_assert( mutex );
+    next_assert( mutex->ok );
+    pthread_mutex_unlock( &mutex->handle );
+}
+
+void next_platform_mutex_destroy( next_platform_mutex_t * mutex )
+{
+    next_assert( mutex );
+    if ( mutex->ok )
     {
         pthread_mutex_destroy( &mutex->handle );
         memset( mutex, 0, sizeof(next_platform_mutex_t) );
@@ -623,6 +2480,196 @@ void next_platform_mutex_destroy( next_platform_mutex_t * mutex )
 
 // ---------------------------------------------------
 
+int next_platform_semaphore_create( next_platform_semaphore_t * semaphore )
+{
+    next_assert( semaphore );
+
+    memset( semaphore, 0, sizeof(next_platform_semaphore_t) );
+
+    if ( sem_init( &semaphore->handle, 0, 0 ) != 0 )
+        return NEXT_ERROR;
+
+    semaphore->ok = true;
+
+    return NEXT_OK;
+}
+
+void next_platform_semaphore_post( next_platform_semaphore_t * semaphore )
+{
+    next_assert( semaphore );
+    next_assert( semaphore->ok );
+    sem_post( &semaphore->handle );
+}
+
+void next_platform_semaphore_wait( next_platform_semaphore_t * semaphore )
+{
+    next_assert( semaphore );
+    next_assert( semaphore->ok );
+    while ( sem_wait( &semaphore->handle ) != 0 && errno == EINTR )
+    {
+        // interrupted by a signal. keep waiting
+    }
+}
+
+void next_platform_semaphore_destroy( next_platform_semaphore_t * semaphore )
+{
+    next_assert( semaphore );
+    if ( semaphore->ok )
+    {
+        sem_destroy( &semaphore->handle );
+        memset( semaphore, 0, sizeof(next_platform_semaphore_t) );
+    }
+}
+
+// ---------------------------------------------------
+
+// IMPORTANT: The waiter takes over blocking for its socket. The socket is switched to non-blocking, and the internal thread
+// sleeps in epoll_wait instead, woken by whichever comes first: packets on the socket (or its io_uring / af_xdp rings), a
+// command pushed by the game thread (eventfd), or the next update deadline (timerfd).
+
+void next_platform_waiter_destroy( next_platform_waiter_t * waiter );
+
+static bool next_platform_waiter_add( next_platform_waiter_t * waiter, int fd, uint32_t event )
+{
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = EPOLLIN;
+    ev.data.u32 = event;
+    if ( epoll_ctl( waiter->epoll_fd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_ERROR, "failed to add fd to epoll set: %s", strerror( errno ) );
+        return false;
+    }
+    return true;
+}
+
+next_platform_waiter_t * next_platform_waiter_create( void * context, next_platform_socket_t * socket )
+{
+    next_assert( socket );
+
+    next_platform_waiter_t * waiter = (next_platform_waiter_t*) next_malloc( context, sizeof( next_platform_waiter_t ) );
+    if ( !waiter )
+        return NULL;
+
+    waiter->context = context;
+    waiter->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    waiter->event_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    waiter->timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+
+    if ( waiter->epoll_fd < 0 || waiter->event_fd < 0 || waiter->timer_fd < 0 )
+    {
+        next_printf( NEXT_LOG_LEVEL_ERROR, "failed to create epoll, eventfd or timerfd: %s", strerror( errno ) );
+        next_platform_waiter_destroy( waiter );
+        return NULL;
+    }
+
+    bool ok = next_platform_waiter_add( waiter, socket->handle, NEXT_PLATFORM_WAIT_SOCKET );
+    if ( ok && socket->uring )
+    {
+        ok = next_platform_waiter_add( waiter, socket->uring->ring_fd, NEXT_PLATFORM_WAIT_SOCKET );
+    }
+    if ( ok && socket->xdp )
+    {
+        ok = next_platform_waiter_add( waiter, socket->xdp->xsk_fd, NEXT_PLATFORM_WAIT_SOCKET );
+    }
+    ok = ok && next_platform_waiter_add( waiter, waiter->event_fd, NEXT_PLATFORM_WAIT_SIGNAL );
+    ok = ok && next_platform_waiter_add( waiter, waiter->timer_fd, NEXT_PLATFORM_WAIT_TIMER );
+
+    if ( !ok )
+    {
+        next_platform_waiter_destroy( waiter );
+        return NULL;
+    }
+
+    socket->type = NEXT_PLATFORM_SOCKET_NON_BLOCKING;
+
+    return waiter;
+}
+
+void next_platform_waiter_destroy( next_platform_waiter_t * waiter )
+{
+    next_assert( waiter );
+
+    if ( waiter->epoll_fd >= 0 )
+        close( waiter->epoll_fd );
+
+    if ( waiter->event_fd >= 0 )
+        close( waiter->event_fd );
+
+    if ( waiter->timer_fd >= 0 )
+        close( waiter->timer_fd );
+
+    next_free( waiter->context, waiter );
+}
+
+void next_platform_waiter_signal( next_platform_waiter_t * waiter )
+{
+    next_assert( waiter );
+    uint64_t value = 1;
+    if ( write( waiter->event_fd, &value, sizeof(value) ) < 0 )
+    {
+        // EAGAIN means the counter is saturated, so the waiter is already signalled
+    }
+}
+
+int next_platform_waiter_wait( next_platform_waiter_t * waiter, double timeout_seconds )
+{
+    next_assert( waiter );
+
+    // a zero itimerspec disarms the timer, so a deadline that has already passed is rounded up to one nanosecond
+
+    int64_t timeout_nanoseconds = int64_t( timeout_seconds * 1000000000.0 );
+    if ( timeout_nanoseconds < 1 )
+    {
+        timeout_nanoseconds = 1;
+    }
+
+    struct itimerspec timer;
+    memset( &timer, 0, sizeof(timer) );
+    timer.it_value.tv_sec = timeout_nanoseconds / 1000000000LL;
+    timer.it_value.tv_nsec = timeout_nanoseconds % 1000000000LL;
+    timerfd_settime( waiter->timer_fd, 0, &timer, NULL );
+
+    struct epoll_event events[NEXT_PLATFORM_WAITER_MAX_EVENTS];
+    const int num_events = epoll_wait( waiter->epoll_fd, events, NEXT_PLATFORM_WAITER_MAX_EVENTS, -1 );
+    if ( num_events < 0 )
+    {
+        if ( errno != EINTR )
+        {
+            next_printf( NEXT_LOG_LEVEL_ERROR, "epoll_wait failed: %s", strerror( errno ) );
+        }
+        return 0;
+    }
+
+    int result = 0;
+    for ( int i = 0; i < num_events; ++i )
+    {
+        result |= events[i].data.u32;
+    }
+
+    uint64_t value;
+
+    if ( result & NEXT_PLATFORM_WAIT_SIGNAL )
+    {
+        if ( read( waiter->event_fd, &value, sizeof(value) ) < 0 )
+        {
+            // another wakeup already drained it
+        }
+    }
+
+    if ( result & NEXT_PLATFORM_WAIT_TIMER )
+    {
+        if ( read( waiter->timer_fd, &value, sizeof(value) ) < 0 )
+        {
+            // the timer was rearmed since it fired
+        }
+    }
+
+    return result;
+}
+
+// ---------------------------------------------------
+
 template <typename T> struct next_vector_t
 {
     T * data;
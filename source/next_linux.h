@@ -30,6 +30,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sched.h>
+#include <semaphore.h>
 
 #define NEXT_PLATFORM_SOCKET_NON_BLOCKING       0
 #define NEXT_PLATFORM_SOCKET_BLOCKING           1
@@ -38,11 +39,35 @@
 
 typedef int next_platform_socket_handle_t;
 
+struct next_platform_socket_gro_t;
+
+struct next_platform_socket_uring_t;
+
+struct next_platform_socket_xdp_t;
+
+struct next_platform_socket_busy_poll_stats_t
+{
+    uint64_t spin_receives;
+    uint64_t blocking_receives;
+    uint64_t spin_latency_samples;
+    uint64_t spin_latency_total_microseconds;
+    uint64_t wakeup_latency_samples;
+    uint64_t wakeup_latency_total_microseconds;
+    uint64_t wakeup_latency_max_microseconds;
+};
+
 struct next_platform_socket_t
 {
     void * context;
     int type;
     next_platform_socket_handle_t handle;
+    bool udp_segment;
+    next_platform_socket_gro_t * gro;
+    next_platform_socket_uring_t * uring;
+    next_platform_socket_xdp_t * xdp;
+    int busy_poll_microseconds;
+    next_platform_socket_busy_poll_stats_t busy_poll_stats;
+    bool receive_timestamps;
 };
 
 // -------------------------------------
@@ -71,6 +96,28 @@ struct next_platform_mutex_t
 
 // -------------------------------------
 
+struct next_platform_semaphore_t
+{
+    bool ok;
+    sem_t handle;
+};
+
+// -------------------------------------
+
+#define NEXT_PLATFORM_WAIT_SOCKET               1
+#define NEXT_PLATFORM_WAIT_SIGNAL               2
+#define NEXT_PLATFORM_WAIT_TIMER                4
+
+struct next_platform_waiter_t
+{
+    void * context;
+    int epoll_fd;
+    int event_fd;
+    int timer_fd;
+};
+
+// -------------------------------------
+
 #endif // #if NEXT_PLATFORM == NEXT_PLATFORM_LINUX
 
 #endif // #ifndef NEXT_LINUX_H